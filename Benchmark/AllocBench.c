@@ -0,0 +1,40 @@
+// Counts translation page heap allocations per write. After warmup every GMD slot has its
+// page, so the steady state should show zero allocations per write
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o alloc_bench Benchmark/AllocBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define KEYS 40000
+#define WRITES 500000
+
+static void do_writes(KVSSD *ssd, int n, const char *phase) {
+    char key[16];
+    size_t allocs_before = tp_alloc_count();
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < n; i++) {
+        int id = bench_rand() % KEYS;
+        int klen = 1 + bench_rand() % 20;
+        int vlen = 1 + bench_rand() % 300;
+        sprintf(key, "%d", id);
+        if (bench_rand() % 10 == 0)
+            delete(ssd, key);
+        else
+            write(ssd, key, i, klen, vlen);
+    }
+    uint64_t t1 = now_ns();
+    size_t allocs = tp_alloc_count() - allocs_before;
+    printf("%-8s %d ops: %zu allocations (%.4f per op), %.0f ns/op\n",
+           phase, n, allocs, (double)allocs / n, (double)(t1 - t0) / n);
+}
+
+int main() {
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+    init_KVSSD(ssd, 4ULL * 1024 * 1024, 1024, 20, 200); // 4096 translation pages
+    bench_seed(3);
+
+    do_writes(ssd, WRITES / 2, "warmup");
+    do_writes(ssd, WRITES, "steady");
+    return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef BENCHUTIL_H
+#define BENCHUTIL_H
+
+// Small helpers shared by the benchmark programs in this folder
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Monotonic clock in nanoseconds
+static inline uint64_t now_ns(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER counter;
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// xorshift64*, fixed seed so every run sees the same keys
+static uint64_t bench_rng_state = 0x2545F4914F6CDD1DULL;
+
+static inline void bench_seed(uint64_t seed) {
+    bench_rng_state = seed ? seed : 0x2545F4914F6CDD1DULL;
+}
+
+static inline uint64_t bench_rand(void) {
+    bench_rng_state ^= bench_rng_state >> 12;
+    bench_rng_state ^= bench_rng_state << 25;
+    bench_rng_state ^= bench_rng_state >> 27;
+    return bench_rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+// Same generator on a caller owned state, for benchmarks with several threads
+static inline uint64_t bench_rand_r(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+// Resident set size in KB (0 where not supported)
+static inline long rss_kb(void) {
+#ifdef __linux__
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == NULL)
+        return 0;
+    if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+        resident = 0;
+    fclose(f);
+    return resident * 4;
+#else
+    return 0;
+#endif
+}
+
+#endif // BENCHUTIL_H
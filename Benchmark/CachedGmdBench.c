@@ -0,0 +1,67 @@
+// Translation pages of a 16 MiB KVSSD kept in DRAM up to a budget (init_KVSSD_cached), the rest
+// in a backing file. After a preload, runs a 50/40/10 write/read/delete mix with keys drawn
+// uniformly and with 80% of the ops on 20% of the keys, for budgets from a sliver of the pages
+// to all of them. Reports the hit ratio, flash page reads and writes per op and throughput.
+// The backing file is a regular file, so its pages mostly come from the OS page cache
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o cached_gmd_bench Benchmark/CachedGmdBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+// ./cached_gmd_bench [backing file path]
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define CAPACITY (16ULL * 1024 * 1024) // small enough for several keys per page
+#define KEYS 100000
+#define OPS 200000
+
+static uint64_t pick_key(bool skewed) {
+    uint64_t r = bench_rand();
+    if (!skewed)
+        return r % KEYS;
+    return bench_rand() % 10 < 8 ? r % (KEYS / 5) : KEYS / 5 + r % (KEYS - KEYS / 5);
+}
+
+static void run(const char *path, int frames, bool skewed) {
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+    init_KVSSD_cached(ssd, CAPACITY, 1024, 20, 200, path, frames);
+    char key[16];
+    bench_seed(7);
+    for (int i = 0; i < KEYS; i++) {
+        sprintf(key, "%d", i);
+        write(ssd, key, i, 1 + bench_rand() % 20, 1 + bench_rand() % 300);
+    }
+
+    KVSSDCacheStats before = kvssd_cache_stats(ssd);
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < OPS; i++) {
+        sprintf(key, "%d", (int)pick_key(skewed));
+        int op = bench_rand() % 10;
+        if (op < 5)
+            write(ssd, key, i, 1 + bench_rand() % 20, 1 + bench_rand() % 300);
+        else if (op < 9)
+            read(ssd, key);
+        else
+            delete(ssd, key);
+    }
+    uint64_t t1 = now_ns();
+    KVSSDCacheStats after = kvssd_cache_stats(ssd);
+
+    uint64_t accesses = after.accesses - before.accesses, misses = after.misses - before.misses;
+    printf("%-7s %6d frames (%6.1f MB) of %6d pages: hit %6.2f%%, flash reads %5.3f/op, writes %5.3f/op, %8.0f ops/s\n",
+           skewed ? "80/20" : "uniform", frames, (double)frames * ssd->page_pool.page_bytes / 1048576.0, kvssd_stats(ssd).tt_pages,
+           100.0 * (accesses - misses) / accesses, (double)misses / OPS,
+           (double)(after.flash_writes - before.flash_writes) / OPS, OPS / ((t1 - t0) / 1e9));
+
+    free_KVSSD(ssd);
+    free(ssd);
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "kvssd_bench.pages";
+    int budgets[] = {256, 1024, 4096, 8192, 12288, 16384};
+    for (int skewed = 0; skewed < 2; skewed++)
+        for (int i = 0; i < 6; i++)
+            run(path, budgets[i], skewed);
+    remove(path);
+    return 0;
+}
@@ -0,0 +1,59 @@
+// Latency of writes that touch a GMD slot for the first time (so they create the translation
+// page) and process RSS, on the default 4 GiB KVSSD. The second pass reruns the same writes
+// after clear_KVSSD, so every page comes from the pool's free list
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o cold_write_bench Benchmark/ColdWriteBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define WRITES 500000
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void run(KVSSD *ssd, const char *label) {
+    static uint32_t cold[WRITES];
+    int n_cold = 0;
+    uint64_t total = 0;
+    char key[16];
+
+    srand(1);
+    for (int i = 1; i <= WRITES; i++) {
+        int klen = 1 + rand() % 20;
+        int vlen = 1 + rand() % 300;
+        sprintf(key, "%d", i);
+        bool first_touch = gmd_page(ssd, get_translation_page(ssd, hash_k(key))) == NULL;
+
+        uint64_t t0 = now_ns();
+        write(ssd, key, i, klen, vlen);
+        uint64_t t1 = now_ns();
+
+        total += t1 - t0;
+        if (first_touch)
+            cold[n_cold++] = (uint32_t)(t1 - t0);
+    }
+
+    qsort(cold, n_cold, sizeof(uint32_t), compare_u32);
+    uint64_t cold_sum = 0;
+    for (int i = 0; i < n_cold; i++)
+        cold_sum += cold[i];
+    printf("%s: %d cold writes, avg %.0f ns, p50 %u ns, p99 %u ns, p99.9 %u ns (all writes avg %.0f ns), RSS %.1f MB\n",
+           label, n_cold, (double)cold_sum / n_cold, cold[n_cold / 2], cold[(int)(n_cold * 0.99)],
+           cold[(int)(n_cold * 0.999)], (double)total / WRITES, rss_kb() / 1024.0);
+}
+
+int main() {
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+    init_KVSSD(ssd, 4ULL * 1024 * 1024 * 1024, 1024, 20, 200);
+
+    run(ssd, "fresh   ");
+    clear_KVSSD(ssd);
+    run(ssd, "recycled");
+
+    free_KVSSD(ssd);
+    free(ssd);
+    return 0;
+}
@@ -0,0 +1,59 @@
+// Hammers D-entry <-> I-entry conversions on full translation pages.
+// Only uses the public TranslationPage API, so it can be built against older commits to compare
+//
+// gcc -O2 -o conversion_bench Benchmark/ConversionBench.c TranslationPage.c -lm
+
+#include "../TranslationPage.h"
+#include "BenchUtil.h"
+
+#define CONVERSIONS 2000000
+
+static void run(int page_size, int slab_size) {
+    int threshold = 2 * slab_size;
+    TranslationPage *tp = create_translation_page(page_size, slab_size, threshold);
+    int tt_slab = page_size / slab_size;
+    int n = tt_slab / 2; // leaves room for I-entries to turn back into D-entries
+
+    uint64_t *hashes = malloc(n * sizeof(uint64_t));
+    char (*keys)[16] = malloc(n * sizeof(*keys));
+    bench_seed(7);
+    for (int i = 0; i < n; i++) {
+        hashes[i] = bench_rand() | 1;
+        sprintf(keys[i], "key%d", i);
+        insert(tp, hashes[i], 8, 8, keys[i], i); // 1 slab D-entry
+    }
+
+    // Every insert flips one entry: D -> I (too large) then I -> D (small again)
+    uint64_t t0 = now_ns();
+    for (int c = 0; c < CONVERSIONS; c++) {
+        int i = bench_rand() % n;
+        insert(tp, hashes[i], 8, threshold * 2, keys[i], c);
+        insert(tp, hashes[i], 8, 8, keys[i], c);
+    }
+    uint64_t t1 = now_ns();
+
+    // Eviction path: fill the page with 2 slab D-entries, then push 1 slab D-entries in
+    TranslationPage *ev = create_translation_page(page_size, slab_size, threshold);
+    int evictions = 0;
+    uint64_t t2 = now_ns();
+    for (int i = 0; i < tt_slab / 2; i++)
+        insert(ev, bench_rand() | 1, slab_size, slab_size, "big", i);
+    for (int i = 0; i < tt_slab / 2; i++) {
+        int before = ev->evictions;
+        insert(ev, bench_rand() | 1, 8, 8, "small", i);
+        evictions += ev->evictions - before;
+    }
+    uint64_t t3 = now_ns();
+
+    printf("page_size=%d slab_size=%d d_entries=%d: %.1f ns per conversion, %d evictions in %.1f us\n",
+           page_size, slab_size, n, (double)(t1 - t0) / (2.0 * CONVERSIONS), evictions, (t3 - t2) / 1000.0);
+    free(hashes);
+    free(keys);
+}
+
+int main() {
+    run(1024, 20);
+    run(4096, 20);
+    run(16384, 16);
+    return 0;
+}
@@ -0,0 +1,117 @@
+// Read latency while other threads rewrite the same keys, with shard locks
+// (init_KVSSD_sharded) and with copy-on-write pages (init_KVSSD_cow). Every read() is timed
+// on its own, so readers stuck behind a writer holding their shard's lock show up in the tail
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o cow_read_bench Benchmark/CowReadBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define CAPACITY (16ULL * 1024 * 1024) // 16384 translation pages
+#define SHARDS 64
+#define KEYS 100000
+#define READS 500000 // per reader
+#define READERS 2
+
+typedef struct {
+    KVSSD *ssd;
+    int id;
+    uint32_t *lat;   // reader: ns per read
+    long ops;        // writer: writes done
+} ThreadArg;
+
+static volatile int stop_writers;
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void *reader(void *p) {
+    ThreadArg *a = p;
+    uint64_t state = 1000 + a->id;
+    char key[16];
+    for (int i = 0; i < READS; i++) {
+        sprintf(key, "%d", (int)(bench_rand_r(&state) % KEYS));
+        uint64_t t0 = now_ns();
+        read(a->ssd, key);
+        uint64_t t1 = now_ns();
+        a->lat[i] = (uint32_t)(t1 - t0 > UINT32_MAX ? UINT32_MAX : t1 - t0);
+    }
+    return NULL;
+}
+
+// Update storm: rewrites preloaded keys with new sizes as fast as it can
+static void *writer(void *p) {
+    ThreadArg *a = p;
+    uint64_t state = 2000 + a->id;
+    char key[16];
+    while (!stop_writers) {
+        uint64_t r = bench_rand_r(&state);
+        sprintf(key, "%d", (int)(r % KEYS));
+        write(a->ssd, key, (int)a->ops, 1 + (r >> 32) % 20, 1 + (r >> 40) % 300);
+        a->ops++;
+    }
+    return NULL;
+}
+
+static void run(bool cow, int writers) {
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+    if (cow)
+        init_KVSSD_cow(ssd, CAPACITY, 1024, 20, 200, SHARDS);
+    else
+        init_KVSSD_sharded(ssd, CAPACITY, 1024, 20, 200, SHARDS);
+
+    char key[16];
+    bench_seed(5);
+    for (int i = 0; i < KEYS; i++) {
+        sprintf(key, "%d", i);
+        write(ssd, key, i, 1 + bench_rand() % 20, 1 + bench_rand() % 300);
+    }
+
+    pthread_t threads[READERS + 8];
+    ThreadArg args[READERS + 8];
+    stop_writers = 0;
+    for (int i = 0; i < writers; i++) {
+        args[READERS + i] = (ThreadArg){ssd, i, NULL, 0};
+        pthread_create(&threads[READERS + i], NULL, writer, &args[READERS + i]);
+    }
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < READERS; i++) {
+        args[i] = (ThreadArg){ssd, i, malloc(READS * sizeof(uint32_t)), 0};
+        pthread_create(&threads[i], NULL, reader, &args[i]);
+    }
+    for (int i = 0; i < READERS; i++)
+        pthread_join(threads[i], NULL);
+    uint64_t t1 = now_ns();
+    stop_writers = 1;
+    long writes = 0;
+    for (int i = 0; i < writers; i++) {
+        pthread_join(threads[READERS + i], NULL);
+        writes += args[READERS + i].ops;
+    }
+
+    int n = READERS * READS;
+    uint32_t *lat = malloc(n * sizeof(uint32_t));
+    for (int i = 0; i < READERS; i++) {
+        memcpy(lat + i * READS, args[i].lat, READS * sizeof(uint32_t));
+        free(args[i].lat);
+    }
+    qsort(lat, n, sizeof(uint32_t), compare_u32);
+    printf("%-6s %d writers: read p50 %5u ns, p99 %7u ns, p99.9 %8u ns, max %9u ns | %.2f M writes/s, %zu pages in use\n",
+           cow ? "cow" : "locked", writers, lat[n / 2], lat[(int)(n * 0.99)], lat[(int)(n * 0.999)], lat[n - 1],
+           writes / ((t1 - t0) / 1e3), ssd->page_pool.pages_in_use);
+
+    free(lat);
+    free_KVSSD(ssd);
+    free(ssd);
+}
+
+int main() {
+    int writers[] = {0, 1, 2, 4};
+    for (int w = 0; w < 4; w++) {
+        run(false, writers[w]);
+        run(true, writers[w]);
+    }
+    return 0;
+}
@@ -0,0 +1,113 @@
+// Fill ratio against rejections for the quadratic retry chain (init_KVSSD) and cuckoo
+// placement (init_KVSSD_cuckoo). A 4 MiB KVSSD (4096 translation pages of 51 slabs) is filled
+// with new keys up to 99% of its slabs, or MAX_KEYS writes. At every fill step the table shows
+// the share of the writes since the last step that were rejected, and pages probed per read of
+// a stored key (all of them are read back there). Two size mixes: I-entries only, so a key is
+// exactly one slab, and sizes around the threshold, where pages also turn D-entries into
+// I-entries
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o cuckoo_bench Benchmark/CuckooBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define CAPACITY (4ULL << 20)
+#define MAX_KEYS 400000
+#define STEP 1024 // writes between fill checks
+
+static const double fills[] = {0.50, 0.60, 0.70, 0.80, 0.85, 0.90, 0.93, 0.95, 0.97, 0.98, 0.99};
+#define FILLS (int)(sizeof(fills) / sizeof(fills[0]))
+
+typedef struct {
+    int reached;                 // fills[] steps the run got to
+    double rejected[FILLS];      // share of the writes up to that step since the one before
+    double probes[FILLS];        // pages per read of a stored key
+    double write_ns;
+    int relocations;
+} Curve;
+
+static double fill_of(KVSSD *ssd) {
+    KVSSDStats st = kvssd_stats(ssd);
+    int tt_slab = ssd->page_size / ssd->slab_size;
+    return (double)st.tt_space / ((double)ssd->gmd_len * tt_slab * ssd->slab_size);
+}
+
+static void run(bool cuckoo, bool mixed, Curve *c) {
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+    if (cuckoo)
+        init_KVSSD_cuckoo(ssd, CAPACITY, 1024, 20, 200);
+    else
+        init_KVSSD(ssd, CAPACITY, 1024, 20, 200);
+    int *stored = malloc(MAX_KEYS * sizeof(int));
+    int n_stored = 0, step_writes = 0, step_rejected = 0;
+    char key[16];
+    uint64_t write_ns = 0, writes = 0;
+    memset(c, 0, sizeof(Curve));
+    bench_seed(11);
+
+    for (int k = 0; k < MAX_KEYS && c->reached < FILLS; k++) {
+        uint64_t r = bench_rand();
+        sprintf(key, "key%d", k);
+        int vlen = mixed ? 1 + r % 300 : 300;
+        uint64_t t0 = now_ns();
+        bool ok = write(ssd, key, k, 16, vlen);
+        write_ns += now_ns() - t0;
+        writes++;
+        step_writes++;
+        if (ok)
+            stored[n_stored++] = k;
+        else
+            step_rejected++;
+
+        if (k % STEP != STEP - 1)
+            continue;
+        double fill = fill_of(ssd);
+        if (fill < fills[c->reached])
+            continue;
+        KVSSDStats before = kvssd_stats(ssd);
+        for (int i = 0; i < n_stored; i++) {
+            sprintf(key, "key%d", stored[i]);
+            read(ssd, key);
+        }
+        KVSSDStats after = kvssd_stats(ssd);
+        // A read that finds its key probed every page it missed in first
+        double probes = 1 + (double)(after.read_retries - before.read_retries) / n_stored;
+        double rejected = (double)step_rejected / step_writes;
+        step_writes = step_rejected = 0;
+        for (; c->reached < FILLS && fill >= fills[c->reached]; c->reached++) {
+            c->probes[c->reached] = probes;
+            c->rejected[c->reached] = rejected;
+        }
+    }
+
+    c->write_ns = (double)write_ns / writes;
+    c->relocations = kvssd_stats(ssd).relocations;
+    free_KVSSD(ssd);
+    free(ssd);
+    free(stored);
+}
+
+int main() {
+    // Results go to stderr, write() prints every retry and rejection on stdout
+    for (int mixed = 0; mixed < 2; mixed++) {
+        Curve quad, cuckoo;
+        run(false, mixed, &quad);
+        run(true, mixed, &cuckoo);
+        fprintf(stderr, "%s\n", mixed ? "klen 16, vlen 1-300 (threshold 200)" : "I-entries only, one slab per key");
+        fprintf(stderr, "%6s | %12s %12s | %12s %12s\n", "fill", "quad reject", "quad probes", "cuckoo rej.", "cuckoo probes");
+        for (int f = 0; f < FILLS; f++) {
+            fprintf(stderr, "%5.0f%% |", fills[f] * 100);
+            if (f < quad.reached)
+                fprintf(stderr, " %11.2f%% %12.3f |", 100 * quad.rejected[f], quad.probes[f]);
+            else
+                fprintf(stderr, " %12s %12s |", "-", "-");
+            if (f < cuckoo.reached)
+                fprintf(stderr, " %11.2f%% %12.3f\n", 100 * cuckoo.rejected[f], cuckoo.probes[f]);
+            else
+                fprintf(stderr, " %12s %12s\n", "-", "-");
+        }
+        fprintf(stderr, "write: quadratic %.0f ns, cuckoo %.0f ns (%d entries relocated)\n\n",
+                quad.write_ns, cuckoo.write_ns, cuckoo.relocations);
+    }
+    return 0;
+}
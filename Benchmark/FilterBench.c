@@ -0,0 +1,104 @@
+// Miss heavy lookups with and without the key filter (kvssd_set_filter) at several sizes. A
+// 64 MiB KVSSD (65536 translation pages, so the retry chain of a missing key finds live pages)
+// is loaded with KEYS keys, then OPS reads at 100%, 90% and 50% misses, OPS read_batch reads at
+// 90% misses and OPS deletes of keys it doesn't hold. Sizes are in filter bits per loaded key,
+// 4 bits per counter. fp is the share of the misses the filter let through to the pages
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o filter_bench Benchmark/FilterBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define CAPACITY (64ULL << 20)
+#define KEYS 500000
+#define OPS 1000000
+#define BATCH 64
+
+static const int bits_per_key[] = {0, 8, 16, 32, 64};
+#define SIZES (int)(sizeof(bits_per_key) / sizeof(bits_per_key[0]))
+
+// Next key of a workload with miss_pct% misses: user keys were loaded, miss keys never were
+static void pick_key(char *key, int miss_pct) {
+    uint64_t r = bench_rand();
+    if ((int)(r % 100) < miss_pct)
+        sprintf(key, "miss%d", (int)((r >> 8) % (KEYS * 4)));
+    else
+        sprintf(key, "user%d", (int)((r >> 8) % KEYS));
+}
+
+static double reads(KVSSD *ssd, int miss_pct) {
+    char key[24];
+    bench_seed(miss_pct + 1);
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < OPS; i++) {
+        pick_key(key, miss_pct);
+        read(ssd, key);
+    }
+    return (double)(now_ns() - t0) / OPS;
+}
+
+static double batched_reads(KVSSD *ssd, int miss_pct) {
+    static char keys[BATCH][24];
+    const char *ptrs[BATCH];
+    bool results[BATCH];
+    bench_seed(miss_pct + 101);
+    uint64_t ns = 0;
+    for (int i = 0; i < OPS; i += BATCH) {
+        for (int j = 0; j < BATCH; j++) {
+            pick_key(keys[j], miss_pct);
+            ptrs[j] = keys[j];
+        }
+        uint64_t t0 = now_ns();
+        read_batch(ssd, ptrs, BATCH, results);
+        ns += now_ns() - t0;
+    }
+    return (double)ns / OPS;
+}
+
+static double deletes(KVSSD *ssd) {
+    char key[24];
+    bench_seed(999);
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < OPS; i++) {
+        pick_key(key, 100);
+        delete(ssd, key);
+    }
+    return (double)(now_ns() - t0) / OPS;
+}
+
+int main() {
+    printf("%8s %9s %10s | %11s %11s %11s %11s %11s | %7s\n", "bits/key", "filter MB", "load ns/op",
+           "read 100%", "read 90%", "read 50%", "batch 90%", "delete 100%", "fp");
+    for (int s = 0; s < SIZES; s++) {
+        KVSSD *ssd = malloc(sizeof(KVSSD));
+        init_KVSSD(ssd, CAPACITY, 1024, 20, 200);
+        uint64_t bytes = (uint64_t)KEYS * bits_per_key[s] / 8;
+        kvssd_set_filter(ssd, bytes);
+
+        char key[24];
+        bench_seed(1);
+        uint64_t t0 = now_ns();
+        for (int i = 0; i < KEYS; i++) {
+            sprintf(key, "user%d", i);
+            write(ssd, key, i, 10, 1 + bench_rand() % 300);
+        }
+        double load = (double)(now_ns() - t0) / KEYS;
+
+        KVSSDStats before = kvssd_stats(ssd);
+        double r100 = reads(ssd, 100);
+        KVSSDStats after = kvssd_stats(ssd);
+        double r90 = reads(ssd, 90);
+        double r50 = reads(ssd, 50);
+        double b90 = batched_reads(ssd, 90);
+        double d100 = deletes(ssd);
+
+        int misses = after.read_errors - before.read_errors;
+        int negatives = after.filter_negatives - before.filter_negatives;
+        printf("%8d %9.2f %10.0f | %11.0f %11.0f %11.0f %11.0f %11.0f | %6.2f%%\n", bits_per_key[s],
+               bytes / (1024.0 * 1024), load, r100, r90, r50, b90, d100,
+               bytes ? 100.0 * (misses - negatives) / misses : 100.0);
+        free_KVSSD(ssd);
+        free(ssd);
+    }
+    return 0;
+}
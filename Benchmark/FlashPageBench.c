@@ -0,0 +1,119 @@
+// Encode and decode throughput of flash page images (encode_flash_page, decode_flash_page) over
+// every translation page of a KVSSD, and how many pages fit in page_size bytes once D-entries
+// carry their headers. Runs the default sparse 4 GiB KVSSD and a 16 MiB one with full pages.
+// Every decoded page is checked against the page it came from. The first pass reads each page
+// from memory, the warm one repeats it over WARM_PAGES pages that stay in cache
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o flash_page_bench Benchmark/FlashPageBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define WARM_PAGES 256
+#define WARM_REPS 200
+
+// Same entries with the same keys, sizes and values
+static bool same_entries(TranslationPage *a, TranslationPage *b) {
+    if (a->dentry_count != b->dentry_count || a->i_entry_count != b->i_entry_count || a->d_entry_slabs != b->d_entry_slabs)
+        return false;
+    for (int i = next_dentry(a, 0); i != -1; i = next_dentry(a, i + 1)) {
+        DEntry *x = &a->d_entries[i];
+        HashMapEntry *e = hashmap_find(b->key_hashes, x->key_hash);
+        if (e == NULL || e->type != D_ENTRY)
+            return false;
+        DEntry *y = &b->d_entries[e->slot];
+        if (strcmp(dentry_key(a, x), dentry_key(b, y)) != 0 || x->klen != y->klen || x->vlen != y->vlen || x->val != y->val)
+            return false;
+    }
+    for (int i = 0; i < a->key_hashes->size; i++) {
+        HashMapEntry *x = &a->key_hashes->table[i];
+        if (x->type == I_ENTRY && key_hash_type(b, x->key_hash) != I_ENTRY)
+            return false;
+    }
+    return true;
+}
+
+static void run(uint64_t capacity, int writes, const char *label) {
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+    init_KVSSD(ssd, capacity, 1024, 20, 200);
+    char key[16];
+    srand(1);
+    for (int i = 1; i <= writes; i++) {
+        int klen = 1 + rand() % 20;
+        int vlen = 1 + rand() % 300;
+        sprintf(key, "%d", i);
+        write(ssd, key, i, klen, vlen);
+    }
+
+    int n = 0;
+    TranslationPage **pages = malloc(ssd->page_pool.pages_in_use * sizeof(TranslationPage *));
+    for (uint64_t i = 0; i < ssd->gmd_len; i++)
+        if (gmd_page(ssd, i) != NULL)
+            pages[n++] = gmd_page(ssd, i);
+
+    int page_size = ssd->page_size;
+    uint8_t *images = malloc((size_t)n * page_size);
+    bool *fits = malloc(n * sizeof(bool));
+    void *scratch = malloc(ssd->page_pool.page_bytes);
+    long d_entries = 0, over = 0;
+    int fit = 0;
+    memset(images, 0, (size_t)n * page_size); // no first touch faults in the timed loop
+
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < n; i++) {
+        fits[i] = encode_flash_page(pages[i], hash_k, images + (size_t)i * page_size);
+        fit += fits[i];
+    }
+    uint64_t t1 = now_ns();
+    for (int i = 0; i < n; i++)
+        if (fits[i])
+            decode_flash_page(scratch, images + (size_t)i * page_size, page_size, ssd->slab_size, ssd->threshold, hash_k);
+    uint64_t t2 = now_ns();
+
+    int warm = n < WARM_PAGES ? n : WARM_PAGES, warm_fit = 0;
+    for (int i = 0; i < warm; i++)
+        warm_fit += fits[i];
+    uint64_t t3 = now_ns();
+    for (int r = 0; r < WARM_REPS; r++)
+        for (int i = 0; i < warm; i++)
+            if (fits[i])
+                encode_flash_page(pages[i], hash_k, images + (size_t)i * page_size);
+    uint64_t t4 = now_ns();
+    for (int r = 0; r < WARM_REPS; r++)
+        for (int i = 0; i < warm; i++)
+            if (fits[i])
+                decode_flash_page(scratch, images + (size_t)i * page_size, page_size, ssd->slab_size, ssd->threshold, hash_k);
+    uint64_t t5 = now_ns();
+
+    int bad = 0;
+    for (int i = 0; i < n; i++) {
+        d_entries += pages[i]->dentry_count;
+        over += flash_page_slabs(pages[i]) - pages[i]->d_entry_slabs - pages[i]->i_entry_count;
+        if (!fits[i])
+            continue;
+        TranslationPage *tp = decode_flash_page(scratch, images + (size_t)i * page_size, page_size, ssd->slab_size, ssd->threshold, hash_k);
+        bad += tp == NULL || !same_entries(pages[i], tp);
+    }
+
+    double reps = (double)warm_fit * WARM_REPS;
+    printf("%-8s %6d pages, %4.1f D-entries/page, headers take %4.2f slabs/page more, %6.2f%% fit, %d mismatches\n",
+           label, n, (double)d_entries / n, (double)over / n, 100.0 * fit / n, bad);
+    printf("         cold: encode %5.0f ns/page (%5.0f MB/s), decode %5.0f ns/page (%5.0f MB/s)\n",
+           (double)(t1 - t0) / fit, fit * (double)page_size / ((t1 - t0) / 1e3),
+           (double)(t2 - t1) / fit, fit * (double)page_size / ((t2 - t1) / 1e3));
+    printf("         warm: encode %5.0f ns/page (%5.0f MB/s), decode %5.0f ns/page (%5.0f MB/s)\n",
+           (t4 - t3) / reps, reps * page_size / ((t4 - t3) / 1e3), (t5 - t4) / reps, reps * page_size / ((t5 - t4) / 1e3));
+
+    free(scratch);
+    free(fits);
+    free(images);
+    free(pages);
+    free_KVSSD(ssd);
+    free(ssd);
+}
+
+int main() {
+    run(4ULL * 1024 * 1024 * 1024, 500000, "4 GiB");
+    run(16ULL * 1024 * 1024, 200000, "16 MiB");
+    return 0;
+}
@@ -0,0 +1,78 @@
+// Key hashing throughput: hash_k one key at a time against hash_k_batch at every lane count
+// the CPU supports, for several key length distributions. Also checks the batch hashes match
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o hash_bench Benchmark/HashBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define KEYS 1000000
+#define BATCH 256
+#define MAX_KEY 256
+
+typedef struct {
+    const char *name;
+    int min_len, max_len;
+} KeyDist;
+
+static const KeyDist dists[] = {
+    {"fixed 6", 6, 6},
+    {"uniform 1-20", 1, 20},
+    {"uniform 16-64", 16, 64},
+    {"uniform 1-256", 1, MAX_KEY},
+};
+
+static void run(const KeyDist *dist) {
+    char *pool = malloc((size_t)KEYS * (MAX_KEY + 1));
+    const char **keys = malloc(KEYS * sizeof(char*));
+    int *lens = malloc(KEYS * sizeof(int));
+    uint64_t *expect = malloc(KEYS * sizeof(uint64_t));
+    uint64_t *got = malloc(KEYS * sizeof(uint64_t));
+
+    // Keys are packed back to back, like keys read out of a request buffer
+    char *k = pool;
+    bench_seed(11);
+    for (int i = 0; i < KEYS; i++) {
+        lens[i] = dist->min_len + bench_rand() % (dist->max_len - dist->min_len + 1);
+        for (int j = 0; j < lens[i]; j++)
+            k[j] = 'a' + bench_rand() % 26;
+        k[lens[i]] = '\0';
+        keys[i] = k;
+        k += lens[i] + 1;
+    }
+
+    memset(expect, 0, KEYS * sizeof(uint64_t));
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < KEYS; i++)
+        expect[i] = hash_k(keys[i]);
+    uint64_t t1 = now_ns();
+    printf("%-14s hash_k          %6.1f ns/key\n", dist->name, (double)(t1 - t0) / KEYS);
+
+    for (int lanes = 1; lanes <= 8; lanes *= 2) {
+        if (lanes == 2 || MurmurHash3_batch_set_lanes(lanes) != lanes)
+            continue;
+        memset(got, 0, KEYS * sizeof(uint64_t));
+        t0 = now_ns();
+        for (int i = 0; i < KEYS; i += BATCH)
+            hash_k_batch(keys + i, lens + i, KEYS - i < BATCH ? KEYS - i : BATCH, got + i);
+        t1 = now_ns();
+        int mismatches = 0;
+        for (int i = 0; i < KEYS; i++)
+            mismatches += got[i] != expect[i];
+        printf("%-14s batch %d lane%s  %6.1f ns/key, %d mismatches\n", dist->name, lanes,
+               lanes == 1 ? " " : "s", (double)(t1 - t0) / KEYS, mismatches);
+    }
+    MurmurHash3_batch_set_lanes(0);
+
+    free(pool);
+    free(keys);
+    free(lens);
+    free(expect);
+    free(got);
+}
+
+int main() {
+    for (size_t d = 0; d < sizeof(dists) / sizeof(dists[0]); d++)
+        run(&dists[d]);
+    return 0;
+}
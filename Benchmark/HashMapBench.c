@@ -0,0 +1,160 @@
+// Compares the per-page HashMap against the original implementation (tt_slab slots,
+// `%` indexing, delete by clearing is_occupied) at high page fill
+//
+// gcc -O2 -o hashmap_bench Benchmark/HashMapBench.c TranslationPage.c -lm
+
+#include "../TranslationPage.h"
+#include "BenchUtil.h"
+
+#define GMD_LEN (1ULL << 22)  // gmd_len of the default 4 GiB KVSSD
+#define LOOKUPS 2000000 // lookups per measurement
+
+// Original table, kept here only as a baseline
+typedef struct {
+    uint64_t key_hash;
+    int value;
+    bool is_occupied;
+} LegacyHashMapEntry;
+
+typedef struct {
+    LegacyHashMapEntry *table;
+    int size;
+} LegacyHashMap;
+
+static LegacyHashMap* legacy_create(int size) {
+    LegacyHashMap *map = malloc(sizeof(LegacyHashMap));
+    map->table = malloc(size * sizeof(LegacyHashMapEntry));
+    map->size = size;
+    for (int i = 0; i < size; i++)
+        map->table[i].is_occupied = false;
+    return map;
+}
+
+static void legacy_put(LegacyHashMap *map, uint64_t key_hash, int value) {
+    int index = key_hash % map->size;
+    while (map->table[index].is_occupied && map->table[index].key_hash != key_hash)
+        index = (index + 1) % map->size;
+    map->table[index].key_hash = key_hash;
+    map->table[index].value = value;
+    map->table[index].is_occupied = true;
+}
+
+static int legacy_get(LegacyHashMap *map, uint64_t key_hash) {
+    int index = key_hash % map->size;
+    while (map->table[index].is_occupied) {
+        if (map->table[index].key_hash == key_hash)
+            return map->table[index].value;
+        index = (index + 1) % map->size;
+    }
+    return NOT_FOUND;
+}
+
+// Number of slots looked at before the lookup ends (hit or empty slot)
+static int legacy_probe_len(LegacyHashMap *map, uint64_t key_hash) {
+    int index = key_hash % map->size, n = 1;
+    while (map->table[index].is_occupied && map->table[index].key_hash != key_hash) {
+        index = (index + 1) % map->size;
+        n++;
+    }
+    return n;
+}
+
+static int probe_len(HashMap *map, uint64_t key_hash) {
+    int index = hash_function_map(key_hash, map->shift), n = 1;
+    while (map->table[index].type != EMPTY_ENTRY && map->table[index].key_hash != key_hash) {
+        index = (index + 1) & map->mask;
+        n++;
+    }
+    return n;
+}
+
+// Key hashes that all land in the same translation page, like a real page sees them
+static uint64_t page_key_hash(uint64_t page_idx) {
+    return (bench_rand() / GMD_LEN) * GMD_LEN + page_idx;
+}
+
+static void run(int page_size, int slab_size) {
+    int tt_slab = page_size / slab_size;
+    int fill = tt_slab - 1; // the original table loops forever on a miss when all slots are full
+    uint64_t *keys = malloc(fill * sizeof(uint64_t));
+    uint64_t *absent = malloc(fill * sizeof(uint64_t));
+
+    bench_seed(42);
+    for (int i = 0; i < fill; i++) {
+        keys[i] = page_key_hash(1234);
+        absent[i] = page_key_hash(1234);
+    }
+
+    LegacyHashMap *legacy = legacy_create(tt_slab);
+    HashMap *map = create_hashmap(tt_slab);
+    for (int i = 0; i < fill; i++) {
+        legacy_put(legacy, keys[i], i);
+        hashmap_put(map, keys[i], D_ENTRY, i);
+    }
+
+    int rounds = LOOKUPS / fill;
+    double l_hit = 0, l_miss = 0, n_hit = 0, n_miss = 0;
+    for (int i = 0; i < fill; i++) {
+        l_hit += legacy_probe_len(legacy, keys[i]);
+        l_miss += legacy_probe_len(legacy, absent[i]);
+        n_hit += probe_len(map, keys[i]);
+        n_miss += probe_len(map, absent[i]);
+    }
+
+    volatile int sink = 0;
+    uint64_t t0 = now_ns();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < fill; i++)
+            sink += legacy_get(legacy, keys[i]);
+    uint64_t t1 = now_ns();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < fill; i++)
+            sink += hashmap_get(map, keys[i]);
+    uint64_t t2 = now_ns();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < fill; i++)
+            sink += legacy_get(legacy, absent[i]);
+    uint64_t t3 = now_ns();
+    for (int r = 0; r < rounds; r++)
+        for (int i = 0; i < fill; i++)
+            sink += hashmap_get(map, absent[i]);
+    uint64_t t4 = now_ns();
+
+    // Rebuild the page from scratch over and over (put + delete churn)
+    uint64_t t5 = now_ns();
+    for (int r = 0; r < rounds / 10; r++)
+        for (int i = 0; i < fill; i++)
+            legacy_put(legacy, keys[i], r);
+    uint64_t t6 = now_ns();
+    for (int r = 0; r < rounds / 10; r++) {
+        for (int i = 0; i < fill; i++)
+            hashmap_delete(map, keys[i]);
+        for (int i = 0; i < fill; i++)
+            hashmap_put(map, keys[i], D_ENTRY, r);
+    }
+    uint64_t t7 = now_ns();
+
+    double ops = (double)rounds * fill;
+    printf("page_size=%d slab_size=%d entries=%d\n", page_size, slab_size, fill);
+    printf("  legacy: slots=%d load=%.2f probe(hit)=%.2f probe(miss)=%.2f get(hit)=%.1fns get(miss)=%.1fns put=%.1fns\n",
+           legacy->size, (double)fill / legacy->size, l_hit / fill, l_miss / fill,
+           (t1 - t0) / ops, (t3 - t2) / ops, (t6 - t5) / (ops / 10));
+    printf("  new:    slots=%d load=%.2f probe(hit)=%.2f probe(miss)=%.2f get(hit)=%.1fns get(miss)=%.1fns delete+put=%.1fns\n",
+           map->size, (double)fill / map->size, n_hit / fill, n_miss / fill,
+           (t2 - t1) / ops, (t4 - t3) / ops, (t7 - t6) / (ops / 10));
+
+    free(keys);
+    free(absent);
+    free(legacy->table);
+    free(legacy);
+    free(map->table);
+    free(map);
+}
+
+int main() {
+    run(1024, 20);
+    run(4096, 20);
+    run(4096, 8);
+    run(16384, 16);
+    return 0;
+}
@@ -0,0 +1,54 @@
+// Per-page index memory and write/read throughput of the default 4 GiB KVSSD, driven like main()
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o index_memory_bench Benchmark/IndexMemoryBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define WRITES 500000
+
+// Bytes spent on the key_hashes index of one translation page
+static size_t page_index_bytes(TranslationPage *tp) {
+    return sizeof(HashMap) + (size_t)tp->key_hashes->size * (sizeof(HashMapEntry) + 1) + CTRL_TAIL;
+}
+
+int main() {
+    long rss_before = rss_kb();
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+    init_KVSSD(ssd, 4ULL * 1024 * 1024 * 1024, 1024, 20, 200);
+
+    char key[16];
+    srand(1);
+    uint64_t t0 = now_ns();
+    for (int i = 1; i <= WRITES; i++) {
+        int klen = 1 + rand() % 20;
+        int vlen = 1 + rand() % 300;
+        sprintf(key, "%d", i);
+        write(ssd, key, i, klen, vlen);
+    }
+    uint64_t t1 = now_ns();
+    int found = 0;
+    for (int i = 1; i <= WRITES; i++) {
+        sprintf(key, "%d", i);
+        found += read(ssd, key);
+    }
+    uint64_t t2 = now_ns();
+
+    size_t pages = 0, index_bytes = 0;
+    for (uint64_t i = 0; i < ssd->gmd_len; i++) {
+        TranslationPage *tp = gmd_page(ssd, i);
+        if (tp == NULL)
+            continue;
+        pages++;
+        index_bytes += page_index_bytes(tp);
+    }
+
+    double per_page = pages ? (double)index_bytes / pages : 0;
+    printf("pages touched: %zu of %llu\n", pages, (unsigned long long)ssd->gmd_len);
+    printf("index bytes per page: %.0f, touched pages: %.1f MB, full GMD: %.1f MB\n",
+           per_page, index_bytes / 1048576.0, per_page * ssd->gmd_len / 1048576.0);
+    printf("RSS: %.1f MB\n", (rss_kb() - rss_before) / 1024.0);
+    printf("write: %.0f ns/op, read: %.0f ns/op (%d found)\n",
+           (double)(t1 - t0) / WRITES, (double)(t2 - t1) / WRITES, found);
+    return 0;
+}
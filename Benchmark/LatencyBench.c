@@ -0,0 +1,57 @@
+// Per path latencies (kvssd_track_latency) of a mixed workload on the default 4 GiB KVSSD, and
+// what tracking them costs: the same ops run with tracking off and on. max_iterations is cut
+// to 100000 so the threshold updates show up as their own path
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o latency_bench Benchmark/LatencyBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define KEYS 200000
+#define OPS 1000000
+
+static double run(bool track, bool print) {
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+    init_KVSSD(ssd, 4ULL * 1024 * 1024 * 1024, 1024, 20, 200);
+    ssd->max_iterations = 100000;
+    kvssd_track_latency(ssd, track);
+    char key[16];
+    bench_seed(5);
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < OPS; i++) {
+        uint64_t r = bench_rand();
+        sprintf(key, "%d", (int)(r % KEYS));
+        int op = (r >> 32) % 10;
+        if (op < 5)
+            write(ssd, key, i, 1 + (r >> 40) % 20, 1 + (r >> 48) % 300);
+        else if (op < 9)
+            read(ssd, key);
+        else
+            delete(ssd, key);
+    }
+    uint64_t t1 = now_ns();
+
+    if (print) {
+        printf("%-18s %9s %9s %8s %8s %8s %9s\n", "path (ns)", "count", "mean", "p50", "p99", "p999", "max");
+        for (int p = 0; p < LATENCY_PATHS; p++) {
+            LatencySummary s = kvssd_latency(ssd, p);
+            printf("%-18s %9llu %9.0f %8llu %8llu %8llu %9llu\n", latency_path_name(p), (unsigned long long)s.count,
+                   s.mean, (unsigned long long)s.p50, (unsigned long long)s.p99, (unsigned long long)s.p999,
+                   (unsigned long long)s.max);
+        }
+    }
+    free_KVSSD(ssd);
+    free(ssd);
+    return OPS / ((t1 - t0) / 1e9);
+}
+
+int main() {
+    run(true, true);
+    double off = 0, on = 0;
+    for (int r = 0; r < 3; r++) { // alternate so drift hits both
+        off += run(false, false);
+        on += run(true, false);
+    }
+    printf("tracking off %.0f ops/s, on %.0f ops/s (%.1f%% slower)\n", off / 3, on / 3, 100 * (1 - on / off));
+    return 0;
+}
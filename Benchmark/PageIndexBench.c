@@ -0,0 +1,204 @@
+// Page index lookups with control bytes (hashmap_get, group probing) against the linear probe
+// it replaced, which compares the key_hash of every slot from the home slot to the first free
+// one. Every page is full: one I-entry per slab, so the table is as loaded as tt_slab lets it
+// be. "hot" looks up one page over and over, "cold" spreads lookups over about 64 MB of pages
+// in random order. lines is the cache lines of control bytes and slots a lookup reads (the
+// page header aside), misses the LLC misses per lookup where perf counters can be read
+//
+// gcc -O2 -o page_index_bench Benchmark/PageIndexBench.c TranslationPage.c -lm
+// (add -mavx2 for 32 byte groups, or -U__SSE2__ for the 8 byte scalar fallback)
+
+#include "../TranslationPage.h"
+#include "BenchUtil.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define GMD_LEN (1ULL << 22)  // gmd_len of the default 4 GiB KVSSD
+#define COLD_BYTES (64 << 20)
+#define LOOKUPS 2000000
+#define REPEATS 5 // timed runs of each probe, alternating, the fastest is kept
+
+#if defined(__AVX2__)
+#define GROUP 32
+#elif defined(__SSE2__)
+#define GROUP 16
+#else
+#define GROUP 8
+#endif
+
+// hashmap_get before the control bytes, kept here only as a baseline
+static int linear_get(HashMap *map, uint64_t key_hash) {
+    int index = hash_function_map(key_hash, map->shift);
+    while (map->table[index].type != EMPTY_ENTRY) {
+        if (map->table[index].key_hash == key_hash)
+            return map->table[index].type == D_ENTRY ? map->table[index].slot : -1;
+        index = (index + 1) & map->mask;
+    }
+    return NOT_FOUND;
+}
+
+static int line_of(const void *p) {
+    return (int)((uintptr_t)p >> 6);
+}
+
+static int linear_lines(HashMap *map, uint64_t key_hash) {
+    int index = hash_function_map(key_hash, map->shift), lines = 1, last = line_of(&map->table[index]);
+    while (map->table[index].type != EMPTY_ENTRY && map->table[index].key_hash != key_hash) {
+        index = (index + 1) & map->mask;
+        if (line_of(&map->table[index]) != last)
+            lines++;
+        last = line_of(&map->table[index]);
+    }
+    return lines;
+}
+
+// Checks the home slot, then walks the groups the way hashmap_find does, the fingerprint is
+// its hash_fingerprint
+static int ctrl_lines(HashMap *map, uint64_t key_hash) {
+    int index = hash_function_map(key_hash, map->shift);
+    HashMapEntry *home = &map->table[index];
+    if (home->type == EMPTY_ENTRY || home->key_hash == key_hash)
+        return 1;
+    uint8_t fingerprint = (uint8_t)((key_hash * 0x9E3779B97F4A7C15ULL) >> (map->shift - 7)) & 0x7f;
+    int lines = 1, last = -1;
+    for (;;) {
+        for (int j = 0; j < GROUP; j++) {
+            int l = line_of(&map->ctrl[index + j]);
+            lines += l != last;
+            last = l;
+        }
+        for (int j = 0; j < GROUP; j++) {
+            uint8_t c = map->ctrl[index + j];
+            if (c == CTRL_EMPTY)
+                return lines;
+            HashMapEntry *e = &map->table[(index + j) & map->mask];
+            if (c == fingerprint && line_of(e) != line_of(home)) {
+                lines++; // slots that match are rarely next to each other
+                if (e->key_hash == key_hash)
+                    return lines;
+            }
+        }
+        index = (index + GROUP) & map->mask;
+    }
+}
+
+// LLC miss counter of this thread, -1 if the kernel won't give one
+static int open_misses(void) {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static uint64_t read_misses(int fd) {
+    uint64_t n = 0;
+#ifdef __linux__
+    if (fd >= 0 && read(fd, &n, sizeof(n)) != sizeof(n))
+        n = 0;
+#endif
+    return n;
+}
+
+typedef struct {
+    double ns;
+    double misses; // -1 without a counter
+} Timing;
+
+static Timing time_gets(bool ctrl, TranslationPage **pages, const int *page_of, const uint64_t *keys, int n, int fd) {
+    volatile int sink = 0;
+    uint64_t m0 = read_misses(fd), t0 = now_ns();
+    for (int i = 0; i < n; i++) {
+        HashMap *map = pages[page_of[i]]->key_hashes;
+        sink += ctrl ? hashmap_get(map, keys[i]) : linear_get(map, keys[i]);
+    }
+    uint64_t t1 = now_ns(), m1 = read_misses(fd);
+    Timing t = {(double)(t1 - t0) / n, fd >= 0 ? (double)(m1 - m0) / n : -1};
+    return t;
+}
+
+static void run(int page_size, int slab_size, int fd) {
+    size_t page_bytes = translation_page_bytes(page_size, slab_size);
+    int n_pages = COLD_BYTES / page_bytes;
+    int tt_slab = page_size / slab_size;
+    char *mem = aligned_alloc(64, (size_t)n_pages * page_bytes);
+    TranslationPage **pages = malloc(n_pages * sizeof(TranslationPage *));
+    uint64_t *stored = malloc((size_t)n_pages * tt_slab * sizeof(uint64_t));
+    bench_seed(7);
+    for (int p = 0; p < n_pages; p++) {
+        pages[p] = init_translation_page(mem + (size_t)p * page_bytes, page_size, slab_size, 200);
+        for (int s = 0; s < tt_slab; s++) {
+            stored[(size_t)p * tt_slab + s] = (bench_rand() / GMD_LEN) * GMD_LEN + p;
+            insert_ientry(pages[p], stored[(size_t)p * tt_slab + s]);
+        }
+    }
+
+    // hits, misses, each hot then cold
+    int *page_of = malloc(LOOKUPS * sizeof(int));
+    uint64_t *keys = malloc(LOOKUPS * sizeof(uint64_t));
+    HashMap *map0 = pages[0]->key_hashes;
+    printf("page_size=%d slab_size=%d: %d entries in %d slots (load %.2f), %d byte groups\n",
+           page_size, slab_size, tt_slab, map0->size, (double)tt_slab / map0->size, GROUP);
+    printf("  %-10s %12s %12s %12s %12s %12s %12s\n", "", "linear ns", "ctrl ns", "linear lines", "ctrl lines",
+           "linear miss", "ctrl miss");
+    for (int miss = 0; miss < 2; miss++) {
+        for (int cold = 0; cold < 2; cold++) {
+            double l_lines = 0, c_lines = 0;
+            for (int i = 0; i < LOOKUPS; i++) {
+                int p = cold ? (int)(bench_rand() % n_pages) : 0;
+                uint64_t r = bench_rand();
+                page_of[i] = p;
+                keys[i] = miss ? (r / GMD_LEN) * GMD_LEN + p : stored[(size_t)p * tt_slab + r % tt_slab];
+                if (i < 100000) {
+                    l_lines += linear_lines(pages[p]->key_hashes, keys[i]);
+                    c_lines += ctrl_lines(pages[p]->key_hashes, keys[i]);
+                }
+            }
+            time_gets(true, pages, page_of, keys, LOOKUPS, -1); // warm the TLB and the branch predictors alike
+            Timing l = {0, 0}, c = {0, 0};
+            for (int r = 0; r < REPEATS; r++) {
+                Timing tl = time_gets(false, pages, page_of, keys, LOOKUPS, fd);
+                Timing tc = time_gets(true, pages, page_of, keys, LOOKUPS, fd);
+                if (r == 0 || tl.ns < l.ns)
+                    l = tl;
+                if (r == 0 || tc.ns < c.ns)
+                    c = tc;
+            }
+            char lm[16] = "-", cm[16] = "-";
+            if (l.misses >= 0) {
+                sprintf(lm, "%.2f", l.misses);
+                sprintf(cm, "%.2f", c.misses);
+            }
+            printf("  %-10s %12.1f %12.1f %12.2f %12.2f %12s %12s\n", miss ? (cold ? "miss cold" : "miss hot") : (cold ? "hit cold" : "hit hot"),
+                   l.ns, c.ns, l_lines / 100000, c_lines / 100000, lm, cm);
+        }
+    }
+
+    free(keys);
+    free(page_of);
+    free(stored);
+    free(pages);
+    free(mem);
+}
+
+int main() {
+    int fd = open_misses();
+    if (fd < 0)
+        printf("no LLC miss counter here, the miss columns stay empty\n");
+    run(1024, 20, fd);   // the default page, load 0.40
+    run(1920, 20, fd);   // load 0.75, the most table_bits allows
+    run(3072, 8, fd);
+    run(16384, 16, fd);
+    return 0;
+}
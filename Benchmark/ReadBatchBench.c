@@ -0,0 +1,74 @@
+// read() in a loop against read_batch at several batch sizes, on the default 4 GiB KVSSD
+// loaded like main(). Lookups pick random loaded keys plus 10% keys that were never written,
+// and read_batch must give the same results and read counters as the read() loop
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o read_batch_bench Benchmark/ReadBatchBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define WRITES 500000
+#define READS 1000000
+#define KEY_SIZE 16
+
+static const int batch_sizes[] = {1, 4, 16, 32, 64, 256, 1024};
+
+int main() {
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+    init_KVSSD(ssd, 4ULL * 1024 * 1024 * 1024, 1024, 20, 200);
+
+    char key[KEY_SIZE];
+    srand(1);
+    for (int i = 1; i <= WRITES; i++) {
+        int klen = 1 + rand() % 20;
+        int vlen = 1 + rand() % 300;
+        sprintf(key, "%d", i);
+        write(ssd, key, i, klen, vlen);
+    }
+
+    char (*lookups)[KEY_SIZE] = malloc((size_t)READS * KEY_SIZE);
+    const char **keys = malloc(READS * sizeof(char *));
+    bool *expect = malloc(READS * sizeof(bool));
+    bool *got = malloc(READS * sizeof(bool));
+    bench_seed(5);
+    for (int i = 0; i < READS; i++) {
+        uint64_t r = bench_rand();
+        if (r % 10 == 0)
+            sprintf(lookups[i], "missing%d", i);
+        else
+            sprintf(lookups[i], "%d", 1 + (int)((r >> 8) % WRITES));
+        keys[i] = lookups[i];
+    }
+
+    int retries = ssd->counters.read_retries, errors = ssd->counters.read_error;
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < READS; i++)
+        expect[i] = read(ssd, keys[i]);
+    uint64_t t1 = now_ns();
+    double loop_ns = (double)(t1 - t0) / READS;
+    int loop_retries = ssd->counters.read_retries - retries, loop_errors = ssd->counters.read_error - errors;
+    printf("read() loop        %6.0f ns/key (%d retries, %d errors)\n", loop_ns, loop_retries, loop_errors);
+
+    for (size_t b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); b++) {
+        int batch = batch_sizes[b];
+        retries = ssd->counters.read_retries;
+        errors = ssd->counters.read_error;
+        t0 = now_ns();
+        for (int i = 0; i < READS; i += batch)
+            read_batch(ssd, keys + i, READS - i < batch ? READS - i : batch, got + i);
+        t1 = now_ns();
+
+        bool same = memcmp(expect, got, READS * sizeof(bool)) == 0 &&
+                    ssd->counters.read_retries - retries == loop_retries && ssd->counters.read_error - errors == loop_errors;
+        double ns = (double)(t1 - t0) / READS;
+        printf("read_batch(%4d)   %6.0f ns/key, %.2fx, %s\n", batch, ns, loop_ns / ns, same ? "same results" : "RESULTS DIFFER");
+    }
+
+    free_KVSSD(ssd);
+    free(ssd);
+    free(lookups);
+    free(keys);
+    free(expect);
+    free(got);
+    return 0;
+}
@@ -0,0 +1,91 @@
+// Throughput of a sharded KVSSD from 1 to 64 threads on mixed read/write workloads. Every
+// run starts from a 1 GiB KVSSD loaded like main(), then the threads split OPS operations
+// on keys drawn from twice the loaded range, so some reads miss and some writes add keys.
+// The first line of each workload is the single threaded KVSSD, without locks
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o shard_bench Benchmark/ShardBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define CAPACITY (1ULL << 30)
+#define PRELOAD 200000
+#define OPS 2000000
+#define SHARDS 4096
+#define MAX_THREADS 64
+
+typedef struct {
+    KVSSD *ssd;
+    int ops;
+    int read_pct;
+    uint64_t seed;
+} Worker;
+
+static void *worker(void *arg) {
+    Worker *w = arg;
+    uint64_t state = w->seed;
+    char key[16];
+    for (int i = 0; i < w->ops; i++) {
+        uint64_t r = bench_rand_r(&state);
+        sprintf(key, "%d", 1 + (int)(r % (2 * PRELOAD)));
+        if ((int)((r >> 32) % 100) < w->read_pct)
+            read(w->ssd, key);
+        else
+            write(w->ssd, key, i, 1 + (r >> 40) % 20, 1 + (r >> 48) % 300);
+    }
+    return NULL;
+}
+
+static void preload(KVSSD *ssd) {
+    char key[16];
+    clear_KVSSD(ssd);
+    ssd->threshold = 200;
+    srand(1);
+    for (int i = 1; i <= PRELOAD; i++) {
+        int klen = 1 + rand() % 20;
+        int vlen = 1 + rand() % 300;
+        sprintf(key, "%d", i);
+        write(ssd, key, i, klen, vlen);
+    }
+}
+
+// Runs OPS operations over the given number of threads, returns millions of ops per second
+static double run(KVSSD *ssd, int threads, int read_pct) {
+    pthread_t tid[MAX_THREADS];
+    Worker workers[MAX_THREADS];
+
+    preload(ssd);
+    uint64_t t0 = now_ns();
+    for (int t = 0; t < threads; t++) {
+        workers[t] = (Worker){ssd, OPS / threads, read_pct, 0x9E3779B97F4A7C15ULL * (t + 1)};
+        pthread_create(&tid[t], NULL, worker, &workers[t]);
+    }
+    for (int t = 0; t < threads; t++)
+        pthread_join(tid[t], NULL);
+    uint64_t t1 = now_ns();
+    return (double)(OPS / threads * threads) / ((t1 - t0) / 1000.0);
+}
+
+int main() {
+    static const int mixes[] = {95, 50};
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+
+    for (size_t m = 0; m < sizeof(mixes) / sizeof(mixes[0]); m++) {
+        init_KVSSD(ssd, CAPACITY, 1024, 20, 200);
+        printf("%d%% reads, single threaded:      %5.2f Mops/s\n", mixes[m], run(ssd, 1, mixes[m]));
+        free_KVSSD(ssd);
+
+        init_KVSSD_sharded(ssd, CAPACITY, 1024, 20, 200, SHARDS);
+        for (int threads = 1; threads <= MAX_THREADS; threads *= 2)
+            printf("%d%% reads, %2d threads, %d shards: %5.2f Mops/s\n",
+                   mixes[m], threads, ssd->shards, run(ssd, threads, mixes[m]));
+
+        KVSSDCounters c = kvssd_counters(ssd);
+        printf("preload and last run: %d retries, %d rejections, %d read retries, %d read errors\n",
+               c.retries, c.rejections, c.read_retries, c.read_error);
+        free_KVSSD(ssd);
+    }
+
+    free(ssd);
+    return 0;
+}
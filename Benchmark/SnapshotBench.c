@@ -0,0 +1,80 @@
+// Restart time of the default 4 GiB KVSSD: rebuilding it by replaying the writes like main()
+// against load_KVSSD of a snapshot, plus reads right after the load (which fault the pages in)
+// and after they are all in. The snapshot is still in the page cache when it is loaded
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o snapshot_bench Benchmark/SnapshotBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+// ./snapshot_bench [snapshot path]
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define WRITES 500000
+#define READS 100000
+
+static double read_ns(KVSSD *ssd, int *found) {
+    char key[16];
+    bench_seed(4);
+    *found = 0;
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < READS; i++) {
+        sprintf(key, "%d", (int)(1 + bench_rand() % WRITES));
+        *found += read(ssd, key);
+    }
+    return (double)(now_ns() - t0) / READS;
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "kvssd_bench.snap";
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+    char key[16];
+
+    uint64_t t0 = now_ns();
+    init_KVSSD(ssd, 4ULL * 1024 * 1024 * 1024, 1024, 20, 200);
+    srand(1);
+    for (int i = 1; i <= WRITES; i++) {
+        int klen = 1 + rand() % 20;
+        int vlen = 1 + rand() % 300;
+        sprintf(key, "%d", i);
+        write(ssd, key, i, klen, vlen);
+    }
+    uint64_t t1 = now_ns();
+    int found;
+    double warm = read_ns(ssd, &found);
+    printf("replay: %d writes in %.1f ms, reads %.0f ns/op (%d of %d found)\n",
+           WRITES, (t1 - t0) / 1e6, warm, found, READS);
+
+    KVSSDStats before = kvssd_stats(ssd);
+    uint64_t t2 = now_ns();
+    if (!save_KVSSD(ssd, path))
+        return 1;
+    uint64_t t3 = now_ns();
+    free_KVSSD(ssd);
+    FILE *f = fopen(path, "rb");
+    fseek(f, 0, SEEK_END);
+    long bytes = ftell(f);
+    fclose(f);
+    printf("save: %d pages in %.1f ms, %.1f MB\n", before.tt_pages, (t3 - t2) / 1e6, bytes / 1048576.0);
+
+    long rss0 = rss_kb();
+    uint64_t t4 = now_ns();
+    if (!load_KVSSD(ssd, path))
+        return 1;
+    uint64_t t5 = now_ns();
+    long rss1 = rss_kb();
+    double first = read_ns(ssd, &found);
+    printf("load: %.2f ms (%.0fx faster than replay), RSS +%.1f MB\n",
+           (t5 - t4) / 1e6, (double)(t1 - t0) / (t5 - t4), (rss1 - rss0) / 1024.0);
+    printf("reads after load: %.0f ns/op (%d of %d found), RSS +%.1f MB\n",
+           first, found, READS, (rss_kb() - rss0) / 1024.0);
+
+    // The reads since the load count in the pages too, so only compare what they leave alone
+    KVSSDStats after = kvssd_stats(ssd);
+    bool same = before.tt_pages == after.tt_pages && before.keys == after.keys && before.tt_space == after.tt_space
+        && before.d_entries == after.d_entries && before.i_entries == after.i_entries;
+    printf("reads with every page in: %.0f ns/op, index %s\n", read_ns(ssd, &found), same ? "matches" : "DIFFERS");
+
+    free_KVSSD(ssd);
+    free(ssd);
+    remove(path);
+    return 0;
+}
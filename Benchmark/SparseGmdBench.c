@@ -0,0 +1,52 @@
+// init_KVSSD time and memory of the GMD radix tree from 4 GiB to 16 TiB. A flat GMD would be
+// 8 bytes per translation page up front, 128 GB at 16 TiB; here memory follows the writes
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o sparse_gmd_bench Benchmark/SparseGmdBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define WRITES 100000
+
+static void run(uint64_t capacity, const char *label) {
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+    long rss0 = rss_kb();
+    uint64_t t0 = now_ns();
+    init_KVSSD(ssd, capacity, 1024, 20, 200);
+    uint64_t t1 = now_ns();
+    long rss1 = rss_kb();
+
+    char key[16];
+    bench_seed(2);
+    uint64_t t2 = now_ns();
+    for (int i = 0; i < WRITES; i++) {
+        sprintf(key, "%d", i);
+        write(ssd, key, i, 1 + bench_rand() % 20, 1 + bench_rand() % 300);
+    }
+    uint64_t t3 = now_ns();
+    int found = 0;
+    for (int i = 0; i < WRITES; i++) {
+        sprintf(key, "%d", i);
+        found += read(ssd, key);
+    }
+    uint64_t t4 = now_ns();
+    long rss2 = rss_kb();
+
+    size_t pages_mb = ssd->page_pool.pages_in_use * ssd->page_pool.page_bytes / 1048576;
+    printf("%-8s %12llu GMD slots: init %7.1f us, +%6.1f MB | %d writes %4.0f ns/op, reads %4.0f ns/op (%d found), +%6.1f MB (%zu MB of pages)",
+           label, (unsigned long long)ssd->gmd_len, (t1 - t0) / 1e3, (rss1 - rss0) / 1024.0, WRITES,
+           (double)(t3 - t2) / WRITES, (double)(t4 - t3) / WRITES, found, (rss2 - rss1) / 1024.0, pages_mb);
+
+    uint64_t t5 = now_ns();
+    free_KVSSD(ssd);
+    uint64_t t6 = now_ns();
+    printf(" | free %.1f ms\n", (t6 - t5) / 1e6);
+    free(ssd);
+}
+
+int main() {
+    run(4ULL << 30, "4 GiB");
+    run(1ULL << 40, "1 TiB");
+    run(16ULL << 40, "16 TiB");
+    return 0;
+}
@@ -0,0 +1,412 @@
+// Microbenchmarks of the TranslationPage primitives and the KVSSD ops over a matrix of
+// page_size / slab_size / threshold, written as JSON so two builds can be compared. Every case
+// starts from the same seed, runs once as warmup and then REPS times; the JSON has the median,
+// min and max ns/op of those runs. Page level cases work on PAGES pages at a time so the timer
+// brackets thousands of ops, and only the ops themselves are timed, never the page setup.
+//
+// The separate I-entry hash sets are gone since key_hashes indexes both entry types, so the
+// hash_set_put / contains / delete of the original code are measured as insert_ientry,
+// key_hash_type and delete_ientry. The insert cases follow the branches of insert(): new D,
+// new I, D update with the same, fewer or more slabs, D -> I, I -> D and I -> I
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o suite Benchmark/Suite.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+// ./suite [out.json]      (default suite.json, a table goes to stdout)
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define SEED 21
+#define REPS 5
+#define PAGES 32            // pages a page level round works on
+#define MIN_OPS 200000      // ops per timed run of a page level case
+#define MAX_ENTRIES 1024    // more than tt_slab of any page in the matrix
+#define E2E_CAPACITY (256ULL * 1024 * 1024)
+#define E2E_KEYS 100000
+
+typedef struct {
+    int page_size, slab_size, threshold;
+} Config;
+
+static const Config matrix[] = {
+    {512, 20, 100}, {512, 20, 200}, {512, 40, 200},
+    {1024, 20, 100}, {1024, 20, 200}, {1024, 40, 200}, {1024, 20, 400},
+    {4096, 20, 200}, {4096, 40, 200}, {4096, 64, 400},
+};
+
+// One round of a page level case: sets up pages, times the ops, returns their ns
+typedef uint64_t (*round_fn)(const Config *c, long *ops);
+
+static TranslationPage *pages[PAGES];
+static void *page_mem[PAGES];
+static uint64_t hashes[PAGES][MAX_ENTRIES];
+static char keys[MAX_ENTRIES][16];
+
+static FILE *json;
+static bool first_result = true;
+
+// Fresh pages with new hashes, so each round probes different buckets
+static void reset_pages(const Config *c) {
+    for (int p = 0; p < PAGES; p++) {
+        pages[p] = init_translation_page(page_mem[p], c->page_size, c->slab_size, c->threshold);
+        for (int i = 0; i < MAX_ENTRIES; i++)
+            hashes[p][i] = bench_rand();
+    }
+}
+
+static int tt_slab(const Config *c) {
+    return c->page_size / c->slab_size;
+}
+
+// Sizes that take exactly slabs slabs
+static inline int vlen_for(const Config *c, int slabs) {
+    return slabs * c->slab_size - 4;
+}
+
+// Fills each page with n D-entries of slabs slabs
+static void fill_d(const Config *c, int n, int slabs) {
+    for (int p = 0; p < PAGES; p++)
+        for (int i = 0; i < n; i++)
+            insert(pages[p], hashes[p][i], 4, vlen_for(c, slabs), keys[i], i);
+}
+
+static void fill_i(const Config *c, int n) {
+    for (int p = 0; p < PAGES; p++)
+        for (int i = 0; i < n; i++)
+            insert(pages[p], hashes[p][i], 4, c->threshold + 1, keys[i], i);
+}
+
+static uint64_t round_hashmap_put(const Config *c, long *ops) {
+    int n = tt_slab(c) / 2;
+    reset_pages(c);
+    uint64_t t0 = now_ns();
+    for (int p = 0; p < PAGES; p++)
+        for (int i = 0; i < n; i++)
+            hashmap_put(pages[p]->key_hashes, hashes[p][i], D_ENTRY, i);
+    *ops = (long)PAGES * n;
+    return now_ns() - t0;
+}
+
+static uint64_t round_hashmap_get(const Config *c, long *ops) {
+    int n = tt_slab(c) / 2;
+    reset_pages(c);
+    fill_d(c, n, 1);
+    volatile int sink = 0;
+    uint64_t t0 = now_ns();
+    for (int p = 0; p < PAGES; p++)
+        for (int i = 0; i < n; i++)
+            sink += hashmap_get(pages[p]->key_hashes, hashes[p][i]);
+    *ops = (long)PAGES * n;
+    return now_ns() - t0;
+}
+
+// Keys that were never inserted, the probe runs to an empty bucket
+static uint64_t round_hashmap_get_miss(const Config *c, long *ops) {
+    int n = tt_slab(c) / 2;
+    reset_pages(c);
+    fill_d(c, n, 1);
+    volatile int sink = 0;
+    uint64_t t0 = now_ns();
+    for (int p = 0; p < PAGES; p++)
+        for (int i = n; i < 2 * n; i++)
+            sink += hashmap_get(pages[p]->key_hashes, hashes[p][i]);
+    *ops = (long)PAGES * n;
+    return now_ns() - t0;
+}
+
+static uint64_t round_hashmap_delete(const Config *c, long *ops) {
+    int n = tt_slab(c) / 2;
+    reset_pages(c);
+    for (int p = 0; p < PAGES; p++)
+        for (int i = 0; i < n; i++)
+            hashmap_put(pages[p]->key_hashes, hashes[p][i], D_ENTRY, i);
+    uint64_t t0 = now_ns();
+    for (int p = 0; p < PAGES; p++)
+        for (int i = 0; i < n; i++)
+            hashmap_delete(pages[p]->key_hashes, hashes[p][i]);
+    *ops = (long)PAGES * n;
+    return now_ns() - t0;
+}
+
+static uint64_t round_insert_ientry(const Config *c, long *ops) {
+    int n = tt_slab(c) / 2;
+    reset_pages(c);
+    uint64_t t0 = now_ns();
+    for (int p = 0; p < PAGES; p++)
+        for (int i = 0; i < n; i++)
+            insert_ientry(pages[p], hashes[p][i]);
+    *ops = (long)PAGES * n;
+    return now_ns() - t0;
+}
+
+// Half D-entries, half I-entries
+static uint64_t round_key_hash_type(const Config *c, long *ops) {
+    int n = tt_slab(c) / 4;
+    reset_pages(c);
+    for (int p = 0; p < PAGES; p++)
+        for (int i = 0; i < 2 * n; i++)
+            insert(pages[p], hashes[p][i], 4, i < n ? vlen_for(c, 1) : c->threshold + 1, keys[i], i);
+    volatile int sink = 0;
+    uint64_t t0 = now_ns();
+    for (int p = 0; p < PAGES; p++)
+        for (int i = 0; i < 2 * n; i++)
+            sink += key_hash_type(pages[p], hashes[p][i]);
+    *ops = (long)PAGES * 2 * n;
+    return now_ns() - t0;
+}
+
+static uint64_t round_delete_ientry(const Config *c, long *ops) {
+    int n = tt_slab(c) / 2;
+    reset_pages(c);
+    fill_i(c, n);
+    uint64_t t0 = now_ns();
+    for (int p = 0; p < PAGES; p++)
+        for (int i = 0; i < n; i++)
+            delete_ientry(pages[p], hashes[p][i]);
+    *ops = (long)PAGES * n;
+    return now_ns() - t0;
+}
+
+// Times insert() of n keys per page with klen 4 and vlen on pages set up by fill
+static uint64_t time_insert(int n, int vlen, long *ops) {
+    uint64_t t0 = now_ns();
+    for (int p = 0; p < PAGES; p++)
+        for (int i = 0; i < n; i++)
+            insert(pages[p], hashes[p][i], 4, vlen, keys[i], i);
+    *ops = (long)PAGES * n;
+    return now_ns() - t0;
+}
+
+static uint64_t round_insert_new_d(const Config *c, long *ops) {
+    reset_pages(c);
+    return time_insert(tt_slab(c) / 2, vlen_for(c, 1), ops);
+}
+
+static uint64_t round_insert_new_i(const Config *c, long *ops) {
+    reset_pages(c);
+    return time_insert(tt_slab(c) / 2, c->threshold + 1, ops);
+}
+
+static uint64_t round_insert_update_d_same(const Config *c, long *ops) {
+    int n = tt_slab(c) / 2;
+    reset_pages(c);
+    fill_d(c, n, 1);
+    return time_insert(n, vlen_for(c, 1) - 1, ops);
+}
+
+static uint64_t round_insert_update_d_shrink(const Config *c, long *ops) {
+    int n = tt_slab(c) / 4;
+    reset_pages(c);
+    fill_d(c, n, 2);
+    return time_insert(n, vlen_for(c, 1), ops);
+}
+
+static uint64_t round_insert_update_d_grow(const Config *c, long *ops) {
+    int n = tt_slab(c) / 3;
+    reset_pages(c);
+    fill_d(c, n, 1);
+    return time_insert(n, vlen_for(c, 2), ops);
+}
+
+static uint64_t round_insert_d_to_i(const Config *c, long *ops) {
+    int n = tt_slab(c) / 2;
+    reset_pages(c);
+    fill_d(c, n, 1);
+    return time_insert(n, c->threshold + 1, ops);
+}
+
+static uint64_t round_insert_i_to_d(const Config *c, long *ops) {
+    int n = tt_slab(c) / 3;
+    reset_pages(c);
+    fill_i(c, n);
+    return time_insert(n, vlen_for(c, 1), ops);
+}
+
+static uint64_t round_insert_update_i(const Config *c, long *ops) {
+    int n = tt_slab(c) / 2;
+    reset_pages(c);
+    fill_i(c, n);
+    return time_insert(n, c->threshold + 2, ops);
+}
+
+// Pages full of D-entries as large as the threshold allows, each new 1 slab D-entry turns
+// one of them into an I-entry
+static uint64_t round_insert_dentry_by_eviction(const Config *c, long *ops) {
+    int big = c->threshold / c->slab_size, n = tt_slab(c) / big;
+    reset_pages(c);
+    fill_d(c, n, big);
+    long done = 0;
+    uint64_t t0 = now_ns();
+    for (int p = 0; p < PAGES; p++)
+        for (int i = n; i < 2 * n; i++)
+            done += insert_dentry_by_eviction(pages[p], hashes[p][i], 4, vlen_for(c, 1), keys[i], i);
+    *ops = done;
+    return now_ns() - t0;
+}
+
+static uint64_t round_delete_dentry(const Config *c, long *ops) {
+    int n = tt_slab(c) / 2;
+    reset_pages(c);
+    fill_d(c, n, 1);
+    uint64_t t0 = now_ns();
+    for (int p = 0; p < PAGES; p++)
+        for (int i = 0; i < n; i++)
+            delete_dentry(pages[p], hashes[p][i]);
+    *ops = (long)PAGES * n;
+    return now_ns() - t0;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Writes one result. c is NULL for cases that don't depend on the page layout
+static void report(const char *name, const Config *c, const double *ns_per_op, long ops) {
+    double s[REPS];
+    memcpy(s, ns_per_op, sizeof(s));
+    qsort(s, REPS, sizeof(double), compare_double);
+    fprintf(json, "%s\n    {\"name\": \"%s\", ", first_result ? "" : ",", name);
+    if (c != NULL)
+        fprintf(json, "\"page_size\": %d, \"slab_size\": %d, \"threshold\": %d, ", c->page_size, c->slab_size, c->threshold);
+    else
+        fprintf(json, "\"page_size\": null, \"slab_size\": null, \"threshold\": null, ");
+    fprintf(json, "\"ops\": %ld, \"ns_per_op\": %.2f, \"ns_per_op_min\": %.2f, \"ns_per_op_max\": %.2f}",
+            ops, s[REPS / 2], s[0], s[REPS - 1]);
+    first_result = false;
+
+    if (c != NULL)
+        printf("%4d/%2d/%3d  ", c->page_size, c->slab_size, c->threshold);
+    else
+        printf("%-13s", "");
+    printf("%-28s %9.2f ns/op (min %.2f, max %.2f)\n", name, s[REPS / 2], s[0], s[REPS - 1]);
+    fflush(stdout);
+}
+
+static void run_page_case(const char *name, round_fn round, const Config *c) {
+    double ns_per_op[REPS];
+    long total = 0;
+    for (int r = -1; r < REPS; r++) { // r = -1 is the warmup
+        bench_seed(SEED);
+        long ops = 0;
+        uint64_t ns = 0;
+        while (ops < MIN_OPS) {
+            long n;
+            ns += round(c, &n);
+            ops += n;
+        }
+        if (r >= 0) {
+            ns_per_op[r] = (double)ns / ops;
+            total = ops;
+        }
+    }
+    report(name, c, ns_per_op, total);
+}
+
+static void run_hash_k(void) {
+    static char hash_keys[E2E_KEYS][24];
+    for (int i = 0; i < E2E_KEYS; i++)
+        sprintf(hash_keys[i], "user%d", i * 7919);
+    double ns_per_op[REPS];
+    volatile uint64_t sink = 0;
+    for (int r = -1; r < REPS; r++) {
+        uint64_t t0 = now_ns();
+        for (int i = 0; i < E2E_KEYS; i++)
+            sink += hash_k(hash_keys[i]);
+        if (r >= 0)
+            ns_per_op[r] = (double)(now_ns() - t0) / E2E_KEYS;
+    }
+    report("hash_k", NULL, ns_per_op, E2E_KEYS);
+}
+
+// write of E2E_KEYS new keys into an empty KVSSD, read of all of them, then delete of all
+static void run_kvssd_ops(const Config *c) {
+    static char e2e_keys[E2E_KEYS][16];
+    static int klens[E2E_KEYS], vlens[E2E_KEYS];
+    double w[REPS], rd[REPS], d[REPS];
+    for (int r = -1; r < REPS; r++) {
+        bench_seed(SEED);
+        for (int i = 0; i < E2E_KEYS; i++) {
+            sprintf(e2e_keys[i], "%d", i);
+            klens[i] = 1 + bench_rand() % 20;
+            vlens[i] = 1 + bench_rand() % 300;
+        }
+        KVSSD *ssd = malloc(sizeof(KVSSD));
+        init_KVSSD(ssd, E2E_CAPACITY, c->page_size, c->slab_size, c->threshold);
+        uint64_t t0 = now_ns();
+        for (int i = 0; i < E2E_KEYS; i++)
+            write(ssd, e2e_keys[i], i, klens[i], vlens[i]);
+        uint64_t t1 = now_ns();
+        for (int i = 0; i < E2E_KEYS; i++)
+            read(ssd, e2e_keys[i]);
+        uint64_t t2 = now_ns();
+        for (int i = 0; i < E2E_KEYS; i++)
+            delete(ssd, e2e_keys[i]);
+        uint64_t t3 = now_ns();
+        free_KVSSD(ssd);
+        free(ssd);
+        if (r >= 0) {
+            w[r] = (double)(t1 - t0) / E2E_KEYS;
+            rd[r] = (double)(t2 - t1) / E2E_KEYS;
+            d[r] = (double)(t3 - t2) / E2E_KEYS;
+        }
+    }
+    report("write", c, w, E2E_KEYS);
+    report("read", c, rd, E2E_KEYS);
+    report("delete", c, d, E2E_KEYS);
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "suite.json";
+    json = fopen(path, "w");
+    if (json == NULL) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return 1;
+    }
+
+    size_t bytes = translation_page_bytes(4096, 20); // largest layout in the matrix
+    for (int p = 0; p < PAGES; p++) {
+        page_mem[p] = aligned_alloc(64, (bytes + 63) & ~(size_t)63);
+        if (page_mem[p] == NULL) {
+            fprintf(stderr, "Failed to allocate memory for benchmark pages\n");
+            return 1;
+        }
+    }
+    for (int i = 0; i < MAX_ENTRIES; i++)
+        sprintf(keys[i], "key%d", i);
+
+    fprintf(json, "{\n  \"seed\": %d,\n  \"reps\": %d,\n  \"results\": [", SEED, REPS);
+    run_hash_k();
+    struct {
+        const char *name;
+        round_fn round;
+    } cases[] = {
+        {"hashmap_put", round_hashmap_put},
+        {"hashmap_get", round_hashmap_get},
+        {"hashmap_get_miss", round_hashmap_get_miss},
+        {"hashmap_delete", round_hashmap_delete},
+        {"insert_ientry", round_insert_ientry},
+        {"key_hash_type", round_key_hash_type},
+        {"delete_ientry", round_delete_ientry},
+        {"insert_new_d", round_insert_new_d},
+        {"insert_new_i", round_insert_new_i},
+        {"insert_update_d_same", round_insert_update_d_same},
+        {"insert_update_d_shrink", round_insert_update_d_shrink},
+        {"insert_update_d_grow", round_insert_update_d_grow},
+        {"insert_d_to_i", round_insert_d_to_i},
+        {"insert_i_to_d", round_insert_i_to_d},
+        {"insert_update_i", round_insert_update_i},
+        {"insert_dentry_by_eviction", round_insert_dentry_by_eviction},
+        {"delete_dentry", round_delete_dentry},
+    };
+    for (size_t m = 0; m < sizeof(matrix) / sizeof(matrix[0]); m++) {
+        for (size_t k = 0; k < sizeof(cases) / sizeof(cases[0]); k++)
+            run_page_case(cases[k].name, cases[k].round, &matrix[m]);
+        run_kvssd_ops(&matrix[m]);
+    }
+    fprintf(json, "\n  ]\n}\n");
+    fclose(json);
+
+    for (int p = 0; p < PAGES; p++)
+        free(page_mem[p]);
+    return 0;
+}
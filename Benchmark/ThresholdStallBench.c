@@ -0,0 +1,62 @@
+// Write latency across threshold updates on the default 4 GiB KVSSD. After a preload, KVP
+// sizes swap between small and large every round of max_iterations writes, so every update
+// changes the threshold. Prints the write that ran update_threshold and the tail of each round,
+// plus how long kvssd_stats takes over the same pages
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o threshold_stall_bench Benchmark/ThresholdStallBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define KEYS 500000
+#define ROUND 100000 // max_iterations
+#define ROUNDS 6
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+int main() {
+    static uint64_t lat[ROUND];
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+    init_KVSSD(ssd, 4ULL * 1024 * 1024 * 1024, 1024, 20, 200);
+    ssd->max_iterations = ROUND; // KEYS is a whole number of rounds
+
+    char key[16];
+    bench_seed(11);
+    for (int i = 0; i < KEYS; i++) {
+        sprintf(key, "%d", i);
+        write(ssd, key, i, 1 + bench_rand() % 20, 1 + bench_rand() % 300);
+    }
+
+    for (int r = 0; r < ROUNDS; r++) {
+        uint64_t stall = 0;
+        int threshold = ssd->threshold;
+        for (int i = 0; i < ROUND; i++) {
+            int klen = 1 + bench_rand() % 20;
+            int vlen = r % 2 ? 200 + bench_rand() % 300 : 1 + bench_rand() % 100;
+            sprintf(key, "%d", (int)(bench_rand() % KEYS));
+
+            uint64_t t0 = now_ns();
+            write(ssd, key, i, klen, vlen);
+            lat[i] = now_ns() - t0;
+
+            if (ssd->curr_iteration == 0) // this write ran update_threshold
+                stall = lat[i];
+        }
+        qsort(lat, ROUND, sizeof(uint64_t), compare_u64);
+        printf("round %d: threshold %3d -> %3d, triggering write %8lu ns | p50 %5lu ns, p99 %6lu ns, p99.9 %7lu ns, max %8lu ns\n",
+               r, threshold, ssd->threshold, stall, lat[ROUND / 2], lat[(int)(ROUND * 0.99)],
+               lat[(int)(ROUND * 0.999)], lat[ROUND - 1]);
+    }
+
+    uint64_t t0 = now_ns();
+    KVSSDStats st = kvssd_stats(ssd);
+    uint64_t t1 = now_ns();
+    printf("kvssd_stats: %.2f ms over %d pages, %d GMD workers\n", (t1 - t0) / 1e6, st.tt_pages, ssd->gmd_workers);
+
+    free_KVSSD(ssd);
+    free(ssd);
+    return 0;
+}
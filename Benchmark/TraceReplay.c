@@ -0,0 +1,202 @@
+// Replays a trace of KVSSD ops and reports throughput per op, retries, rejections and how
+// reads were served. One op per line, fields separated by spaces, tabs or commas:
+//
+//     W <key> <klen> <vlen>     write (U is taken as a write too)
+//     R <key>                   read
+//     D <key>                   delete
+//
+// The op may also be spelled out (write, read, delete, update), klen defaults to the key's
+// length and vlen to 0, and lines that are empty or start with # are skipped. The trace is
+// mapped, not read, and lines are parsed where they sit. Only a key is copied, to end it with
+// the NUL the KVSSD API wants. Pages behind the cursor are dropped as it goes, so however long
+// the trace, at most 2 * DROP_BEHIND of it is resident
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o trace_replay Benchmark/TraceReplay.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+// ./trace_replay <trace> [capacity GiB] [page_size slab_size threshold]
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MAX_KEY 255
+#define DROP_BEHIND (8 << 20)  // bytes of trace kept mapped in behind the cursor
+#define PROGRESS 100000000     // ops between progress lines
+
+enum { OP_WRITE, OP_READ, OP_DELETE, OPS };
+
+static const char *op_names[OPS] = {"write", "read", "delete"};
+
+typedef struct {
+    uint64_t count;
+    uint64_t ok;  // writes stored, reads found, deletes that removed a key
+    uint64_t ns;
+} OpTotals;
+
+static inline bool is_sep(char c) {
+    return c == ' ' || c == '\t' || c == ',' || c == '\r';
+}
+
+static inline const char *skip_sep(const char *p, const char *end) {
+    while (p < end && is_sep(*p))
+        p++;
+    return p;
+}
+
+// Parses a decimal field at *p. Leaves def when the line has no more fields
+static inline bool parse_int(const char **p, const char *end, int def, int *out) {
+    const char *s = skip_sep(*p, end);
+    *out = def;
+    if (s == end || *s == '\n') {
+        *p = s;
+        return true;
+    }
+    long v = 0;
+    const char *d = s;
+    while (d < end && *d >= '0' && *d <= '9' && v <= INT32_MAX)
+        v = v * 10 + (*d++ - '0');
+    if (d == s || v > INT32_MAX || (d < end && !is_sep(*d) && *d != '\n'))
+        return false;
+    *out = (int)v;
+    *p = d;
+    return true;
+}
+
+// Op of a line from its first field, -1 if there is none
+static inline int parse_op(const char **p, const char *end) {
+    const char *s = *p;
+    int op;
+    switch (*s | 0x20) { // lower case
+        case 'w': case 'u': op = OP_WRITE; break;
+        case 'r': op = OP_READ; break;
+        case 'd': op = OP_DELETE; break;
+        default: return -1;
+    }
+    while (s < end && !is_sep(*s) && *s != '\n')
+        s++;
+    *p = s;
+    return op;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <trace> [capacity GiB] [page_size slab_size threshold]\n", argv[0]);
+        return 1;
+    }
+    uint64_t capacity = (argc > 2 ? strtoull(argv[2], NULL, 10) : 4) << 30;
+    int page_size = argc > 5 ? atoi(argv[3]) : 1024;
+    int slab_size = argc > 5 ? atoi(argv[4]) : 20;
+    int threshold = argc > 5 ? atoi(argv[5]) : 200;
+
+    FILE *f = fopen(argv[1], "rb");
+    struct stat sb;
+    if (f == NULL || fstat(fileno(f), &sb) != 0) {
+        fprintf(stderr, "Failed to open trace %s\n", argv[1]);
+        return 1;
+    }
+    size_t bytes = sb.st_size;
+    const char *trace = bytes == 0 ? NULL : mmap(NULL, bytes, PROT_READ, MAP_SHARED, fileno(f), 0);
+    fclose(f); // the mapping keeps the file
+    if (trace == MAP_FAILED) {
+        fprintf(stderr, "Failed to map trace %s\n", argv[1]);
+        return 1;
+    }
+    if (bytes > 0)
+        madvise((void *)trace, bytes, MADV_SEQUENTIAL);
+
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+    if (ssd == NULL) {
+        fprintf(stderr, "Failed to allocate memory for KVSSD.\n");
+        return 1;
+    }
+    init_KVSSD(ssd, capacity, page_size, slab_size, threshold);
+
+    OpTotals totals[OPS];
+    memset(totals, 0, sizeof(totals));
+    uint64_t lines = 0, bad = 0, ops = 0;
+    char key[MAX_KEY + 1];
+    const char *p = trace, *end = trace + bytes, *dropped = trace;
+
+    uint64_t t0 = now_ns();
+    while (p < end) {
+        const char *nl = memchr(p, '\n', end - p);
+        const char *eol = nl == NULL ? end : nl;
+        lines++;
+
+        const char *s = skip_sep(p, eol);
+        if (s == eol || *s == '#') {
+            p = eol + 1;
+            continue;
+        }
+        int op = parse_op(&s, eol);
+        s = skip_sep(s, eol);
+        const char *k = s;
+        while (s < eol && !is_sep(*s))
+            s++;
+        int key_len = s - k;
+        int klen, vlen;
+        if (op < 0 || key_len == 0 || key_len > MAX_KEY
+            || !parse_int(&s, eol, key_len, &klen) || !parse_int(&s, eol, 0, &vlen) || skip_sep(s, eol) != eol) {
+            bad++;
+            p = eol + 1;
+            continue;
+        }
+        memcpy(key, k, key_len);
+        key[key_len] = '\0';
+
+        uint64_t start = now_ns();
+        bool ok;
+        if (op == OP_WRITE)
+            ok = write(ssd, key, (int)lines, klen, vlen);
+        else if (op == OP_READ)
+            ok = read(ssd, key);
+        else
+            ok = delete(ssd, key);
+        totals[op].ns += now_ns() - start;
+        totals[op].count++;
+        totals[op].ok += ok;
+        p = eol + 1;
+
+        if (p - dropped > 2 * DROP_BEHIND) {
+            // Whole pages only, the one the cursor is on stays
+            size_t n = (p - dropped - DROP_BEHIND) & ~(size_t)4095;
+            madvise((void *)dropped, n, MADV_DONTNEED);
+            dropped += n;
+        }
+        if (++ops % PROGRESS == 0)
+            fprintf(stderr, "%llu ops, %.1f%% of the trace, RSS %.1f MB\n", (unsigned long long)ops,
+                    100.0 * (p - trace) / bytes, rss_kb() / 1024.0);
+    }
+    uint64_t t1 = now_ns();
+
+    KVSSDStats st = kvssd_stats(ssd);
+    double secs = (t1 - t0) / 1e9;
+    printf("%s: %llu lines, %llu ops, %llu skipped as malformed, %.2f s (%.0f ops/s with parsing), RSS %.1f MB\n",
+           argv[1], (unsigned long long)lines, (unsigned long long)ops, (unsigned long long)bad, secs,
+           ops / secs, rss_kb() / 1024.0);
+    for (int o = 0; o < OPS; o++) {
+        if (totals[o].count == 0)
+            continue;
+        printf("  %-6s %12llu ops, %12llu ok, %7.0f ns/op, %10.0f ops/s\n", op_names[o],
+               (unsigned long long)totals[o].count, (unsigned long long)totals[o].ok,
+               (double)totals[o].ns / totals[o].count, totals[o].count / (totals[o].ns / 1e9));
+    }
+
+    uint64_t writes = totals[OP_WRITE].count, reads = totals[OP_READ].count;
+    printf("  writes: %d new D, %d new I, %d D updates, %d I updates, %d evictions, %d retries (%.4f/write), %d rejections\n",
+           st.new_d_entry, st.new_i_entry, st.update_d_entry, st.update_i_entry, st.evictions, st.retries,
+           writes ? (double)st.retries / writes : 0, st.rejections);
+    if (reads > 0)
+        printf("  reads: %.2f%% D-entry hits, %.2f%% I-entry hits, %.2f%% misses, %d retries (%.4f/read)\n",
+               100.0 * st.read_d_entry / reads, 100.0 * st.read_i_entry / reads, 100.0 * st.read_errors / reads,
+               st.read_retries, (double)st.read_retries / reads);
+    printf("  index: %d keys in %d translation pages, %d D-entries, %d I-entries\n",
+           st.keys, st.tt_pages, st.d_entries, st.i_entries);
+
+    free_KVSSD(ssd);
+    free(ssd);
+    if (bytes > 0)
+        munmap((void *)trace, bytes);
+    return 0;
+}
@@ -0,0 +1,116 @@
+// Write throughput of a 4 GiB KVSSD with the write-ahead log on a local file, against no log,
+// over a range of group commit intervals. Async calls return once their record is buffered,
+// wait calls once it is on disk, so single threaded wait mode pays one disk write per group
+// and several threads share one. Ends with how fast replay_wal rebuilds the KVSSD from the log
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o wal_bench Benchmark/WalBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+// ./wal_bench [log path]
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define CAPACITY (4ULL * 1024 * 1024 * 1024)
+#define KEYS 200000
+#define SECONDS 1.0 // each run writes for about this long
+#define MAX_THREADS 8
+
+typedef struct {
+    KVSSD *ssd;
+    int id;
+    long ops;
+} ThreadArg;
+
+static uint64_t deadline;
+
+static void *writer(void *p) {
+    ThreadArg *a = p;
+    uint64_t state = 3000 + a->id;
+    char key[16];
+    while (now_ns() < deadline) {
+        for (int i = 0; i < 64; i++) {
+            uint64_t r = bench_rand_r(&state);
+            sprintf(key, "%d", (int)(r % KEYS));
+            write(a->ssd, key, (int)a->ops, 1 + (r >> 32) % 20, 1 + (r >> 40) % 300);
+            a->ops++;
+        }
+    }
+    return NULL;
+}
+
+// Writes for SECONDS with threads writers and prints ops/s. interval_us < 0 means no log
+static void run(const char *path, int threads, int batch, int interval_us, bool wait, const char *label) {
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+    if (threads > 1)
+        init_KVSSD_sharded(ssd, CAPACITY, 1024, 20, 200, 64);
+    else
+        init_KVSSD(ssd, CAPACITY, 1024, 20, 200);
+    remove(path);
+    if (interval_us >= 0 && !kvssd_open_wal(ssd, path, batch, interval_us, wait))
+        exit(1);
+
+    pthread_t tid[MAX_THREADS];
+    ThreadArg args[MAX_THREADS];
+    uint64_t t0 = now_ns();
+    deadline = t0 + (uint64_t)(SECONDS * 1e9);
+    for (int i = 0; i < threads; i++) {
+        args[i] = (ThreadArg){ssd, i, 0};
+        pthread_create(&tid[i], NULL, writer, &args[i]);
+    }
+    long ops = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tid[i], NULL);
+        ops += args[i].ops;
+    }
+    kvssd_sync_wal(ssd); // async runs pay for the tail too
+    uint64_t t1 = now_ns();
+
+    printf("%-28s %d thread%s: %9.0f ops/s\n", label, threads, threads > 1 ? "s" : " ", ops / ((t1 - t0) / 1e9));
+    free_KVSSD(ssd);
+    free(ssd);
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "kvssd_bench.wal";
+    int intervals[] = {0, 100, 1000, 10000};
+    char label[64];
+
+    run(path, 1, 1, -1, false, "no log");
+    for (int i = 0; i < 4; i++) {
+        sprintf(label, "async, interval %5d us", intervals[i]);
+        run(path, 1, 4096, intervals[i], false, label);
+    }
+    for (int i = 0; i < 3; i++) {
+        sprintf(label, "wait, interval %5d us", intervals[i]);
+        run(path, 1, 4096, intervals[i], true, label);
+    }
+    int threads[] = {2, 8};
+    for (int t = 0; t < 2; t++) {
+        for (int i = 0; i < 3; i++) {
+            sprintf(label, "wait, interval %5d us", intervals[i]);
+            run(path, threads[t], threads[t], intervals[i], true, label);
+        }
+    }
+
+    // Replays the log of one more async run
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+    init_KVSSD(ssd, CAPACITY, 1024, 20, 200);
+    remove(path);
+    kvssd_open_wal(ssd, path, 4096, 1000, false);
+    char key[16];
+    bench_seed(6);
+    for (int i = 0; i < 500000; i++) {
+        sprintf(key, "%d", (int)(bench_rand() % KEYS));
+        write(ssd, key, i, 1 + bench_rand() % 20, 1 + bench_rand() % 300);
+    }
+    free_KVSSD(ssd);
+
+    init_KVSSD(ssd, CAPACITY, 1024, 20, 200);
+    uint64_t t0 = now_ns();
+    long n = replay_wal(ssd, path);
+    uint64_t t1 = now_ns();
+    printf("replay_wal: %ld records in %.1f ms, %.0f records/s\n", n, (t1 - t0) / 1e6, n / ((t1 - t0) / 1e9));
+    free_KVSSD(ssd);
+    free(ssd);
+    remove(path);
+    return 0;
+}
@@ -0,0 +1,120 @@
+// write() in a loop, like main(), against write_batch at several batch sizes. Each run starts
+// from an empty KVSSD and ends with a digest of every translation page, which has to match
+// the write() loop. The second workload overwrites keys on a small KVSSD so pages fill up,
+// retries happen and the threshold is updated during the run
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o write_batch_bench Benchmark/WriteBatchBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define KEY_SIZE 16
+
+typedef struct {
+    const char *name;
+    uint64_t capacity;
+    int writes;
+    int keys; // 0: every write is a new key
+    int preload; // keys 1..preload are written before the timed writes
+    int max_iterations;
+} Workload;
+
+static const Workload workloads[] = {
+    {"main() loop, 4 GiB", 4ULL * 1024 * 1024 * 1024, 500000, 0, 0, 1000000},
+    {"updates, 4 GiB", 4ULL * 1024 * 1024 * 1024, 500000, 500000, 500000, 1000000},
+    {"overwrites, 4 MiB", 4ULL * 1024 * 1024, 300000, 30000, 0, 100000},
+};
+
+static const int batch_sizes[] = {16, 64, 256, 1024, 4096};
+
+// Mixes the state of every translation page and the KVSSD counters
+static uint64_t digest(KVSSD *ssd) {
+    uint64_t h = 1469598103934665603ULL;
+    for (uint64_t i = 0; i < ssd->gmd_len; i++) {
+        TranslationPage *tp = gmd_page(ssd, i);
+        if (tp == NULL)
+            continue;
+        uint64_t v[] = {i, tp->threshold, tp->d_entry_slabs, tp->i_entry_count, tp->dentry_count,
+                        tp->key_hashes->count, tp->inserts, tp->updates, tp->evictions, tp->rejections};
+        for (size_t k = 0; k < sizeof(v) / sizeof(v[0]); k++)
+            h = (h ^ v[k]) * 1099511628211ULL;
+        for (int j = next_dentry(tp, 0); j != -1; j = next_dentry(tp, j + 1))
+            h = (h ^ tp->d_entries[j].key_hash ^ (uint64_t)tp->d_entries[j].num_slabs << 56) * 1099511628211ULL;
+    }
+    uint64_t v[] = {ssd->threshold, ssd->counters.retries, ssd->counters.rejections};
+    for (size_t k = 0; k < sizeof(v) / sizeof(v[0]); k++)
+        h = (h ^ v[k]) * 1099511628211ULL;
+    return h;
+}
+
+// Empties the KVSSD and writes the preloaded keys
+static void reset(KVSSD *ssd, const Workload *w) {
+    char key[KEY_SIZE];
+    clear_KVSSD(ssd);
+    ssd->threshold = 200;
+    for (int i = 1; i <= w->preload; i++) {
+        sprintf(key, "%d", i);
+        write(ssd, key, i, 1 + i % 20, 1 + i % 300);
+    }
+}
+
+static void run(const Workload *w) {
+    char (*keys)[KEY_SIZE] = malloc((size_t)w->writes * KEY_SIZE);
+    kv_op *ops = malloc(w->writes * sizeof(kv_op));
+    bool *results = malloc(w->writes * sizeof(bool));
+
+    srand(1);
+    for (int i = 0; i < w->writes; i++) {
+        int id = w->keys ? 1 + rand() % w->keys : i + 1;
+        sprintf(keys[i], "%d", id);
+        ops[i].key = keys[i];
+        ops[i].val = i;
+        ops[i].klen = 1 + rand() % 20;
+        ops[i].vlen = 1 + rand() % 300;
+    }
+
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+    init_KVSSD(ssd, w->capacity, 1024, 20, 200);
+    ssd->max_iterations = w->max_iterations;
+
+    // Untimed first pass so every timed run gets its pages from the pool's free list
+    for (int i = 0; i < w->writes; i++)
+        write(ssd, ops[i].key, ops[i].val, ops[i].klen, ops[i].vlen);
+    reset(ssd, w);
+
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < w->writes; i++)
+        write(ssd, ops[i].key, ops[i].val, ops[i].klen, ops[i].vlen);
+    uint64_t t1 = now_ns();
+    uint64_t expect = digest(ssd);
+    int retries = ssd->counters.retries, rejections = ssd->counters.rejections;
+    double loop_ns = (double)(t1 - t0) / w->writes;
+    fprintf(stderr, "%s: write() loop %.0f ns/op (%d retries, %d rejections)\n",
+            w->name, loop_ns, retries, rejections);
+
+    for (size_t b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); b++) {
+        int batch = batch_sizes[b];
+        reset(ssd, w);
+
+        t0 = now_ns();
+        for (int i = 0; i < w->writes; i += batch)
+            write_batch(ssd, ops + i, w->writes - i < batch ? w->writes - i : batch, results + i);
+        t1 = now_ns();
+        double ns = (double)(t1 - t0) / w->writes;
+        fprintf(stderr, "%s: write_batch(%4d) %.0f ns/op, %.2fx, state %s\n", w->name, batch, ns,
+                loop_ns / ns, digest(ssd) == expect ? "matches" : "DIFFERS");
+    }
+
+    free_KVSSD(ssd);
+    free(ssd);
+    free(keys);
+    free(ops);
+    free(results);
+}
+
+int main() {
+    // Summary lines go to stderr, write() itself prints every retry on stdout
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++)
+        run(&workloads[w]);
+    return 0;
+}
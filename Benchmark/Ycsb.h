@@ -0,0 +1,329 @@
+#ifndef YCSB_H
+#define YCSB_H
+
+// YCSB core workloads A-F for the benchmark programs in this folder. Key choice follows YCSB's
+// generators (uniform, zipfian, scrambled zipfian, latest) and KVP sizes come from a SizeDist.
+// Everything is drawn from the generator's own seeded state, so a seed always gives the same ops.
+// Keys are "user<id>". The KVSSD keeps no key order, so a scan reads the ids after its start
+// key one at a time, which is what a scan costs a hash indexed store
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../KVSSD.h"
+#include "BenchUtil.h"
+
+#define YCSB_ZIPF_THETA 0.99
+#define YCSB_SCRAMBLED_ITEMS 10000000000ULL // scrambled zipfian draws from this many, then hashes
+#define YCSB_SCRAMBLED_ZETA 26.46902820178302 // zeta(YCSB_SCRAMBLED_ITEMS, 0.99), as YCSB has it
+
+typedef enum { KEYS_UNIFORM, KEYS_ZIPFIAN, KEYS_SCRAMBLED_ZIPFIAN, KEYS_LATEST } KeyDistribution;
+
+typedef enum { SIZE_FIXED, SIZE_UNIFORM, SIZE_LOGNORMAL, SIZE_HISTOGRAM } SizeKind;
+
+// Distribution of a klen or vlen. Every kind is clamped to [min, max]
+typedef struct {
+    SizeKind kind;
+    int min, max;           // fixed uses min
+    double mu, sigma;       // lognormal: exp(mu + sigma * N(0, 1))
+    int buckets;            // histogram: sizes[i] is drawn with probability counts[i] / total
+    int *sizes;
+    double *cdf;
+} SizeDist;
+
+typedef enum { YCSB_READ, YCSB_UPDATE, YCSB_INSERT, YCSB_SCAN, YCSB_RMW, YCSB_OPS } YcsbOpKind;
+
+// Op mix of a workload, the proportions add up to 1
+typedef struct {
+    char name;
+    double read, update, insert, scan, rmw;
+    KeyDistribution keys;
+    int max_scan;           // scan lengths are uniform in [1, max_scan]
+} YcsbWorkload;
+
+static const YcsbWorkload ycsb_workloads[6] = {
+    {'A', 0.50, 0.50, 0,    0,    0,    KEYS_ZIPFIAN, 0},   // update heavy
+    {'B', 0.95, 0.05, 0,    0,    0,    KEYS_ZIPFIAN, 0},   // read mostly
+    {'C', 1,    0,    0,    0,    0,    KEYS_ZIPFIAN, 0},   // read only
+    {'D', 0.95, 0,    0.05, 0,    0,    KEYS_LATEST,  0},   // read latest
+    {'E', 0,    0,    0.05, 0.95, 0,    KEYS_ZIPFIAN, 100}, // short ranges
+    {'F', 0.50, 0,    0,    0,    0.50, KEYS_ZIPFIAN, 0},   // read-modify-write
+};
+
+// YCSB's ZipfianGenerator (Gray et al., "Quickly generating billion-record synthetic
+// databases"). zetan grows with the item count instead of being recomputed
+typedef struct {
+    double theta, alpha, zeta2, zetan, eta;
+    uint64_t items;         // zetan covers this many
+} Zipfian;
+
+typedef struct {
+    YcsbOpKind kind;
+    uint64_t key;           // id of the key, see ycsb_key
+    int scan;               // ids key..key+scan-1 for a scan
+    int klen, vlen;         // sizes an update, insert or rmw writes
+} YcsbOp;
+
+typedef struct {
+    YcsbWorkload w;
+    uint64_t state;
+    uint64_t inserted;      // ids [0, inserted) exist
+    Zipfian zipf;
+    SizeDist klen, vlen;
+    double spare;           // second normal of the last Box-Muller pair
+    bool has_spare;
+} Ycsb;
+
+static inline double ycsb_uniform(Ycsb *y) {
+    return (bench_rand_r(&y->state) >> 11) * 0x1p-53;
+}
+
+static inline double ycsb_normal(Ycsb *y) {
+    if (y->has_spare) {
+        y->has_spare = false;
+        return y->spare;
+    }
+    double u = 1 - ycsb_uniform(y), v = ycsb_uniform(y);
+    double r = sqrt(-2 * log(u));
+    y->spare = r * sin(2 * M_PI * v);
+    y->has_spare = true;
+    return r * cos(2 * M_PI * v);
+}
+
+static inline uint64_t fnv_hash64(uint64_t v) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (int i = 0; i < 8; i++) {
+        h ^= v & 0xff;
+        h *= 1099511628211ULL;
+        v >>= 8;
+    }
+    return h;
+}
+
+static inline void zipfian_grow(Zipfian *z, uint64_t items) {
+    for (uint64_t i = z->items + 1; i <= items; i++)
+        z->zetan += 1 / pow((double)i, z->theta);
+    z->items = items;
+    z->eta = (1 - pow(2.0 / items, 1 - z->theta)) / (1 - z->zeta2 / z->zetan);
+}
+
+static inline void zipfian_init(Zipfian *z, uint64_t items, double theta) {
+    z->theta = theta;
+    z->alpha = 1 / (1 - theta);
+    z->zeta2 = 1 + pow(0.5, theta);
+    z->zetan = 0;
+    z->items = 0;
+    zipfian_grow(z, items < 2 ? 2 : items);
+}
+
+// Rank in [0, items), 0 the most popular. items may only grow between calls
+static inline uint64_t zipfian_next(Zipfian *z, double u, uint64_t items) {
+    if (items > z->items)
+        zipfian_grow(z, items);
+    double uz = u * z->zetan;
+    if (uz < 1)
+        return 0;
+    if (uz < z->zeta2)
+        return 1;
+    uint64_t r = (uint64_t)(items * pow(z->eta * u - z->eta + 1, z->alpha));
+    return r < items ? r : items - 1;
+}
+
+static inline SizeDist size_fixed(int size) {
+    return (SizeDist){SIZE_FIXED, size, size, 0, 0, 0, NULL, NULL};
+}
+
+static inline SizeDist size_uniform(int min, int max) {
+    return (SizeDist){SIZE_UNIFORM, min, max, 0, 0, 0, NULL, NULL};
+}
+
+// Median exp(mu), clamped to [min, max]
+static inline SizeDist size_lognormal(double mu, double sigma, int min, int max) {
+    return (SizeDist){SIZE_LOGNORMAL, min, max, mu, sigma, 0, NULL, NULL};
+}
+
+// Replays a histogram: sizes[i] seen counts[i] times. Copies both, free with size_dist_free
+static inline SizeDist size_histogram(const int *sizes, const uint64_t *counts, int buckets) {
+    SizeDist d = {SIZE_HISTOGRAM, 1, 0x7fffffff, 0, 0, buckets, malloc(buckets * sizeof(int)), malloc(buckets * sizeof(double))};
+    if (d.sizes == NULL || d.cdf == NULL) {
+        fprintf(stderr, "Failed to allocate memory for size histogram\n");
+        exit(1);
+    }
+    double total = 0;
+    for (int i = 0; i < buckets; i++)
+        total += counts[i];
+    double sum = 0;
+    for (int i = 0; i < buckets; i++) {
+        sum += counts[i];
+        d.sizes[i] = sizes[i];
+        d.cdf[i] = sum / total;
+    }
+    return d;
+}
+
+// Reads a histogram file of "size count" lines, see size_histogram. Exits if there is none
+static inline SizeDist size_histogram_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    int cap = 64, n = 0;
+    int *sizes = malloc(cap * sizeof(int));
+    uint64_t *counts = malloc(cap * sizeof(uint64_t));
+    if (f == NULL || sizes == NULL || counts == NULL) {
+        fprintf(stderr, "Failed to read size histogram %s\n", path);
+        exit(1);
+    }
+    unsigned long long c;
+    while (fscanf(f, "%d %llu", &sizes[n], &c) == 2) {
+        counts[n++] = c;
+        if (n == cap) {
+            cap *= 2;
+            sizes = realloc(sizes, cap * sizeof(int));
+            counts = realloc(counts, cap * sizeof(uint64_t));
+            if (sizes == NULL || counts == NULL) {
+                fprintf(stderr, "Failed to allocate memory for size histogram\n");
+                exit(1);
+            }
+        }
+    }
+    fclose(f);
+    if (n == 0) {
+        fprintf(stderr, "Size histogram %s is empty\n", path);
+        exit(1);
+    }
+    SizeDist d = size_histogram(sizes, counts, n);
+    free(sizes);
+    free(counts);
+    return d;
+}
+
+static inline void size_dist_free(SizeDist *d) {
+    free(d->sizes);
+    free(d->cdf);
+    d->sizes = NULL;
+    d->cdf = NULL;
+}
+
+static inline int size_next(Ycsb *y, const SizeDist *d) {
+    double s;
+    switch (d->kind) {
+        case SIZE_FIXED:
+            return d->min;
+        case SIZE_UNIFORM:
+            return d->min + (int)(bench_rand_r(&y->state) % (uint64_t)(d->max - d->min + 1));
+        case SIZE_LOGNORMAL:
+            s = exp(d->mu + d->sigma * ycsb_normal(y));
+            return s < d->min ? d->min : s > d->max ? d->max : (int)s;
+        default: {
+            double u = ycsb_uniform(y);
+            int lo = 0, hi = d->buckets - 1;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (d->cdf[mid] <= u)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            return d->sizes[lo];
+        }
+    }
+}
+
+// records keys exist once ycsb_load has run. The generator keeps klen and vlen (and any
+// histogram they point to), which must outlive it
+static inline void ycsb_init(Ycsb *y, const YcsbWorkload *w, uint64_t records, uint64_t seed, SizeDist klen, SizeDist vlen) {
+    y->w = *w;
+    y->state = seed ? seed : 0x2545F4914F6CDD1DULL;
+    y->inserted = records;
+    y->klen = klen;
+    y->vlen = vlen;
+    y->has_spare = false;
+    if (w->keys == KEYS_SCRAMBLED_ZIPFIAN) {
+        zipfian_init(&y->zipf, 2, YCSB_ZIPF_THETA);
+        y->zipf.items = YCSB_SCRAMBLED_ITEMS;
+        y->zipf.zetan = YCSB_SCRAMBLED_ZETA;
+        y->zipf.eta = (1 - pow(2.0 / YCSB_SCRAMBLED_ITEMS, 1 - YCSB_ZIPF_THETA)) / (1 - y->zipf.zeta2 / YCSB_SCRAMBLED_ZETA);
+    } else if (w->keys != KEYS_UNIFORM) {
+        zipfian_init(&y->zipf, records, YCSB_ZIPF_THETA);
+    }
+}
+
+// Id of an existing key, drawn the workload's way
+static inline uint64_t ycsb_choose(Ycsb *y) {
+    uint64_t n = y->inserted;
+    switch (y->w.keys) {
+        case KEYS_UNIFORM:
+            return bench_rand_r(&y->state) % n;
+        case KEYS_ZIPFIAN:
+            return zipfian_next(&y->zipf, ycsb_uniform(y), n);
+        case KEYS_SCRAMBLED_ZIPFIAN:
+            return fnv_hash64(zipfian_next(&y->zipf, ycsb_uniform(y), YCSB_SCRAMBLED_ITEMS)) % n;
+        default: // latest: the newest keys are the most popular
+            return n - 1 - zipfian_next(&y->zipf, ycsb_uniform(y), n);
+    }
+}
+
+static inline void ycsb_next(Ycsb *y, YcsbOp *op) {
+    double u = ycsb_uniform(y);
+    const YcsbWorkload *w = &y->w;
+    op->scan = 0;
+    if (u < w->read)
+        op->kind = YCSB_READ;
+    else if (u < w->read + w->update)
+        op->kind = YCSB_UPDATE;
+    else if (u < w->read + w->update + w->insert)
+        op->kind = YCSB_INSERT;
+    else if (u < w->read + w->update + w->insert + w->scan)
+        op->kind = YCSB_SCAN;
+    else
+        op->kind = YCSB_RMW;
+
+    if (op->kind == YCSB_INSERT) {
+        op->key = y->inserted++;
+    } else {
+        op->key = ycsb_choose(y);
+        if (op->kind == YCSB_SCAN)
+            op->scan = 1 + bench_rand_r(&y->state) % w->max_scan;
+    }
+    op->klen = size_next(y, &y->klen);
+    op->vlen = size_next(y, &y->vlen);
+}
+
+static inline void ycsb_key(uint64_t id, char *key) {
+    sprintf(key, "user%llu", (unsigned long long)id);
+}
+
+// Writes keys [0, records) in order with the generator's sizes
+static inline void ycsb_load(KVSSD *ssd, Ycsb *y, uint64_t records) {
+    char key[32];
+    for (uint64_t i = 0; i < records; i++) {
+        ycsb_key(i, key);
+        write(ssd, key, (int)i, size_next(y, &y->klen), size_next(y, &y->vlen));
+    }
+}
+
+// Runs op against ssd. Returns false if a read found nothing or a write was rejected
+static inline bool ycsb_apply(KVSSD *ssd, const YcsbOp *op, int val) {
+    char key[32];
+    ycsb_key(op->key, key);
+    switch (op->kind) {
+        case YCSB_READ:
+            return read(ssd, key);
+        case YCSB_UPDATE:
+        case YCSB_INSERT:
+            return write(ssd, key, val, op->klen, op->vlen);
+        case YCSB_SCAN: {
+            bool all = true;
+            for (int i = 0; i < op->scan; i++) {
+                ycsb_key(op->key + i, key);
+                all &= read(ssd, key);
+            }
+            return all;
+        }
+        default:
+            return read(ssd, key) & write(ssd, key, val, op->klen, op->vlen);
+    }
+}
+
+#endif // YCSB_H
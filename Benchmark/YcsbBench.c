@@ -0,0 +1,76 @@
+// YCSB workloads A-F (Ycsb.h) on the default 4 GiB KVSSD: loads RECORDS keys, then runs OPS ops
+// of each workload on a fresh KVSSD. vlen is lognormal around the threshold, so hot keys keep
+// flipping between D-entries and I-entries. Then workload A again with every key distribution,
+// and with fixed, uniform and histogram sizes. Pass a "size count" histogram file to replay it
+// as the vlen distribution of that last set
+//
+// gcc -O2 -DKVSSD_NO_MAIN -o ycsb_bench Benchmark/YcsbBench.c KVSSD.c TranslationPage.c HashFunction/Murmurhash3New.c -lm -lpthread
+// ./ycsb_bench [vlen histogram]
+
+#include "Ycsb.h"
+
+#define CAPACITY (4ULL * 1024 * 1024 * 1024)
+#define RECORDS 200000
+#define OPS 500000
+#define SEED 42
+
+static const char *key_names[] = {"uniform", "zipfian", "scrambled", "latest"};
+
+static void run(const YcsbWorkload *w, SizeDist klen, SizeDist vlen, const char *sizes) {
+    KVSSD *ssd = malloc(sizeof(KVSSD));
+    init_KVSSD(ssd, CAPACITY, 1024, 20, 200);
+    Ycsb y;
+    ycsb_init(&y, w, RECORDS, SEED, klen, vlen);
+    ycsb_load(ssd, &y, RECORDS);
+    KVSSDStats before = kvssd_stats(ssd);
+
+    uint64_t counts[YCSB_OPS] = {0}, failed = 0, reads = 0;
+    YcsbOp op;
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < OPS; i++) {
+        ycsb_next(&y, &op);
+        failed += !ycsb_apply(ssd, &op, i);
+        counts[op.kind]++;
+        reads += op.kind == YCSB_SCAN ? op.scan : op.kind == YCSB_READ || op.kind == YCSB_RMW;
+    }
+    uint64_t t1 = now_ns();
+
+    KVSSDStats st = kvssd_stats(ssd);
+    int read_d = st.read_d_entry - before.read_d_entry, read_i = st.read_i_entry - before.read_i_entry;
+    printf("%c %-9s %-10s %8.0f ops/s | r %6llu u %6llu i %5llu s %6llu rmw %6llu | "
+           "D->I %6d, D upd %6d, I upd %6d, retries %d, rejections %d | reads D %5.1f%% I %5.1f%%, %llu failed\n",
+           w->name, key_names[w->keys], sizes, OPS / ((t1 - t0) / 1e9),
+           (unsigned long long)counts[YCSB_READ], (unsigned long long)counts[YCSB_UPDATE],
+           (unsigned long long)counts[YCSB_INSERT], (unsigned long long)counts[YCSB_SCAN],
+           (unsigned long long)counts[YCSB_RMW], st.evictions - before.evictions,
+           st.update_d_entry - before.update_d_entry, st.update_i_entry - before.update_i_entry,
+           st.retries - before.retries, st.rejections - before.rejections,
+           reads ? 100.0 * read_d / reads : 0, reads ? 100.0 * read_i / reads : 0, (unsigned long long)failed);
+
+    free_KVSSD(ssd);
+    free(ssd);
+}
+
+int main(int argc, char **argv) {
+    SizeDist klen = size_uniform(1, 20);
+    SizeDist vlen = size_lognormal(log(120), 0.8, 1, 1000);
+    for (int i = 0; i < 6; i++)
+        run(&ycsb_workloads[i], klen, vlen, "lognormal");
+
+    YcsbWorkload a = ycsb_workloads[0];
+    for (int k = KEYS_UNIFORM; k <= KEYS_LATEST; k++) {
+        a.keys = k;
+        run(&a, klen, vlen, "lognormal");
+    }
+
+    // Mostly small values with a tail past the threshold
+    int sizes[] = {16, 64, 128, 180, 250, 400, 900};
+    uint64_t counts[] = {20, 30, 20, 10, 10, 7, 3};
+    SizeDist hist = argc > 1 ? size_histogram_file(argv[1]) : size_histogram(sizes, counts, 7);
+    a.keys = KEYS_ZIPFIAN;
+    run(&a, klen, size_fixed(100), "fixed 100");
+    run(&a, klen, size_uniform(1, 300), "uniform");
+    run(&a, klen, hist, "histogram");
+    size_dist_free(&hist);
+    return 0;
+}
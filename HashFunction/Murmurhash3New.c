@@ -68,3 +68,210 @@ uint64_t MurmurHash3_x64_64(const void *key, int len, uint32_t seed) {
     
     return h1;
 }
+
+
+// Batched version. All lanes run the same block loop; a lane whose key has fewer blocks
+// keeps its h1 unchanged for the extra iterations. The tail is read as a little endian
+// integer, which is what the switch above builds, and a zero tail leaves h1 unchanged
+static inline uint64_t tail64(const uint8_t *data, int len) {
+    int rem = len & 7;
+    uint64_t k1 = 0;
+    if (rem == 0)
+        return 0;
+    if (len >= 8) {
+        // One load of the last 8 bytes, dropping the ones that belong to the last block
+        memcpy(&k1, data + len - 8, 8);
+        return k1 >> (64 - 8 * rem);
+    }
+    for (int i = rem - 1; i >= 0; i--)
+        k1 = (k1 << 8) | data[i];
+    return k1;
+}
+
+static void murmur_batch_scalar(const char *const *keys, const int *lens, int n, uint32_t seed, uint64_t *out) {
+    for (int i = 0; i < n; i++)
+        out[i] = MurmurHash3_x64_64(keys[i], lens[i], seed);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MURMUR_SIMD 1
+#include <immintrin.h>
+
+// Low 64 bits of a * b per lane, AVX2 only has a 32 x 32 -> 64 multiply
+__attribute__((target("avx2")))
+static inline __m256i mul64_avx2(__m256i a, __m256i b) {
+    __m256i lo = _mm256_mul_epu32(a, b);
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+                                     _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+    return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+#define ROTL64_AVX2(x, r) _mm256_or_si256(_mm256_slli_epi64(x, r), _mm256_srli_epi64(x, 64 - (r)))
+
+__attribute__((target("avx2")))
+static void murmur_batch_avx2(const char *const *keys, const int *lens, int n, uint32_t seed, uint64_t *out) {
+    const __m256i c1 = _mm256_set1_epi64x(BIG_CONSTANT(0x87c37b91114253d5));
+    const __m256i c2 = _mm256_set1_epi64x(BIG_CONSTANT(0x4cf5ad432745937f));
+    const __m256i f1 = _mm256_set1_epi64x(BIG_CONSTANT(0xff51afd7ed558ccd));
+    const __m256i f2 = _mm256_set1_epi64x(BIG_CONSTANT(0xc4ceb9fe1a85ec53));
+    const __m256i add = _mm256_set1_epi64x(0x52dce729);
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        const uint8_t *d[4];
+        int max_blocks = 0;
+        for (int l = 0; l < 4; l++) {
+            d[l] = (const uint8_t *)keys[i + l];
+            if (lens[i + l] / 8 > max_blocks)
+                max_blocks = lens[i + l] / 8;
+        }
+        __m256i nblocks = _mm256_set_epi64x(lens[i + 3] / 8, lens[i + 2] / 8, lens[i + 1] / 8, lens[i] / 8);
+        __m256i addr = _mm256_set_epi64x((int64_t)(uintptr_t)d[3], (int64_t)(uintptr_t)d[2],
+                                         (int64_t)(uintptr_t)d[1], (int64_t)(uintptr_t)d[0]);
+        __m256i h1 = _mm256_set1_epi64x(seed);
+
+        // Body, block b of every lane that still has one is gathered straight from its key
+        for (int b = 0; b < max_blocks; b++) {
+            __m256i active = _mm256_cmpgt_epi64(nblocks, _mm256_set1_epi64x(b));
+            __m256i k1 = _mm256_mask_i64gather_epi64(_mm256_setzero_si256(), NULL, addr, active, 1);
+            addr = _mm256_add_epi64(addr, _mm256_set1_epi64x(8));
+            k1 = mul64_avx2(k1, c1);
+            k1 = ROTL64_AVX2(k1, 31);
+            k1 = mul64_avx2(k1, c2);
+
+            __m256i h = _mm256_xor_si256(h1, k1);
+            h = ROTL64_AVX2(h, 27);
+            h = _mm256_add_epi64(_mm256_add_epi64(_mm256_slli_epi64(h, 2), h), add); // h * 5 + 0x52dce729
+            h1 = _mm256_blendv_epi8(h1, h, active);
+        }
+
+        // Tail
+        __m256i k1 = _mm256_set_epi64x(tail64(d[3], lens[i + 3]), tail64(d[2], lens[i + 2]),
+                                       tail64(d[1], lens[i + 1]), tail64(d[0], lens[i]));
+        k1 = mul64_avx2(k1, c1);
+        k1 = ROTL64_AVX2(k1, 31);
+        k1 = mul64_avx2(k1, c2);
+        h1 = _mm256_xor_si256(h1, k1);
+
+        // Finalization
+        h1 = _mm256_xor_si256(h1, _mm256_set_epi64x(lens[i + 3], lens[i + 2], lens[i + 1], lens[i]));
+        h1 = _mm256_xor_si256(h1, _mm256_srli_epi64(h1, 33));
+        h1 = mul64_avx2(h1, f1);
+        h1 = _mm256_xor_si256(h1, _mm256_srli_epi64(h1, 33));
+        h1 = mul64_avx2(h1, f2);
+        h1 = _mm256_xor_si256(h1, _mm256_srli_epi64(h1, 33));
+        _mm256_storeu_si256((__m256i *)(out + i), h1);
+    }
+
+    murmur_batch_scalar(keys + i, lens + i, n - i, seed, out + i);
+}
+
+__attribute__((target("avx512f,avx512dq")))
+static void murmur_batch_avx512(const char *const *keys, const int *lens, int n, uint32_t seed, uint64_t *out) {
+    const __m512i c1 = _mm512_set1_epi64(BIG_CONSTANT(0x87c37b91114253d5));
+    const __m512i c2 = _mm512_set1_epi64(BIG_CONSTANT(0x4cf5ad432745937f));
+    const __m512i f1 = _mm512_set1_epi64(BIG_CONSTANT(0xff51afd7ed558ccd));
+    const __m512i f2 = _mm512_set1_epi64(BIG_CONSTANT(0xc4ceb9fe1a85ec53));
+    const __m512i five = _mm512_set1_epi64(5);
+    const __m512i add = _mm512_set1_epi64(0x52dce729);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        uint64_t addr64[8], nb[8], tails[8], len64[8];
+        int max_blocks = 0;
+        for (int l = 0; l < 8; l++) {
+            addr64[l] = (uint64_t)(uintptr_t)keys[i + l];
+            nb[l] = lens[i + l] / 8;
+            tails[l] = tail64((const uint8_t *)keys[i + l], lens[i + l]);
+            len64[l] = (uint64_t)lens[i + l];
+            if ((int)nb[l] > max_blocks)
+                max_blocks = nb[l];
+        }
+        __m512i nblocks = _mm512_loadu_si512(nb);
+        __m512i addr = _mm512_loadu_si512(addr64);
+        __m512i h1 = _mm512_set1_epi64(seed);
+
+        // Body, block b of every lane that still has one is gathered straight from its key
+        for (int b = 0; b < max_blocks; b++) {
+            __mmask8 active = _mm512_cmpgt_epu64_mask(nblocks, _mm512_set1_epi64(b));
+            __m512i k1 = _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), active, addr, NULL, 1);
+            addr = _mm512_add_epi64(addr, _mm512_set1_epi64(8));
+            k1 = _mm512_mullo_epi64(k1, c1);
+            k1 = _mm512_rol_epi64(k1, 31);
+            k1 = _mm512_mullo_epi64(k1, c2);
+
+            __m512i h = _mm512_xor_si512(h1, k1);
+            h = _mm512_rol_epi64(h, 27);
+            h = _mm512_add_epi64(_mm512_mullo_epi64(h, five), add);
+            h1 = _mm512_mask_mov_epi64(h1, active, h);
+        }
+
+        // Tail
+        __m512i k1 = _mm512_loadu_si512(tails);
+        k1 = _mm512_mullo_epi64(k1, c1);
+        k1 = _mm512_rol_epi64(k1, 31);
+        k1 = _mm512_mullo_epi64(k1, c2);
+        h1 = _mm512_xor_si512(h1, k1);
+
+        // Finalization
+        h1 = _mm512_xor_si512(h1, _mm512_loadu_si512(len64));
+        h1 = _mm512_xor_si512(h1, _mm512_srli_epi64(h1, 33));
+        h1 = _mm512_mullo_epi64(h1, f1);
+        h1 = _mm512_xor_si512(h1, _mm512_srli_epi64(h1, 33));
+        h1 = _mm512_mullo_epi64(h1, f2);
+        h1 = _mm512_xor_si512(h1, _mm512_srli_epi64(h1, 33));
+        _mm512_storeu_si512(out + i, h1);
+    }
+
+    murmur_batch_scalar(keys + i, lens + i, n - i, seed, out + i);
+}
+#endif
+
+static int batch_lanes = 0; // 0 until the first call picks the default
+
+static int supported_lanes(void) {
+#ifdef MURMUR_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+        return 8;
+    if (__builtin_cpu_supports("avx2"))
+        return 4;
+#endif
+    return 1;
+}
+
+// AVX-512 when there is one. The AVX2 lanes gather their blocks and build each 64-bit multiply
+// out of 32x32 ones, which loses to the scalar loop on short and long keys alike, so they are
+// only used when asked for
+static int default_lanes(void) {
+    return supported_lanes() == 8 ? 8 : 1;
+}
+
+int MurmurHash3_batch_set_lanes(int lanes) {
+    int best = supported_lanes();
+    if (lanes <= 0)
+        lanes = default_lanes();
+    else if (lanes > best)
+        lanes = best;
+    lanes = lanes >= 8 ? 8 : lanes >= 4 ? 4 : 1;
+    __atomic_store_n(&batch_lanes, lanes, __ATOMIC_RELAXED); // threads may be hashing meanwhile
+    return lanes;
+}
+
+void MurmurHash3_x64_64_batch(const char *const *keys, const int *lens, int n, uint32_t seed, uint64_t *out) {
+    int lanes = __atomic_load_n(&batch_lanes, __ATOMIC_RELAXED);
+    if (lanes == 0)
+        lanes = MurmurHash3_batch_set_lanes(0);
+
+#ifdef MURMUR_SIMD
+    if (lanes == 8) {
+        murmur_batch_avx512(keys, lens, n, seed, out);
+        return;
+    }
+    if (lanes == 4) {
+        murmur_batch_avx2(keys, lens, n, seed, out);
+        return;
+    }
+#endif
+    murmur_batch_scalar(keys, lens, n, seed, out);
+}
@@ -1,6 +1,17 @@
+#ifndef MURMURHASH3NEW_H
+#define MURMURHASH3NEW_H
+
 #include <stdint.h>
 #include <string.h>
 
-static inline uint64_t getblock64(const uint64_t *p, int i);
-static inline uint64_t fmix64(uint64_t k);
-uint64_t MurmurHash3_x64_64(const void *key, int len, uint32_t seed);
\ No newline at end of file
+uint64_t MurmurHash3_x64_64(const void *key, int len, uint32_t seed);
+
+// Hashes n keys, out[i] == MurmurHash3_x64_64(keys[i], lens[i], seed).
+// Runs 8 keys per step with AVX-512, otherwise one at a time, picked at runtime
+void MurmurHash3_x64_64_batch(const char *const *keys, const int *lens, int n, uint32_t seed, uint64_t *out);
+
+// Forces the lane count used by MurmurHash3_x64_64_batch (1, 4 or 8), limited to what the
+// CPU supports. Returns the lane count now in use. Pass 0 to go back to the default
+int MurmurHash3_batch_set_lanes(int lanes);
+
+#endif // MURMURHASH3NEW_H
@@ -1,10 +1,21 @@
 #include "KVSSD.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sysinfo.h>
+#endif
+
+static uint64_t next_instance = 1;
+static __thread uint64_t cached_instance;     // KVSSD the calling thread last used
+static __thread KVSSDThread *cached_thread;   // and its state there
 
 // Function to initialize a KVSSD instance
 void init_KVSSD(KVSSD *ssd, uint64_t capacity, int page_size, int slab_size, int threshold) {
     ssd->curr_iteration = 0;
     ssd->max_iterations = 1000000;
-    ssd->kvp_sizes = (int *)malloc(ssd->max_iterations * sizeof(int));
+    memset(&ssd->kv_sizes, 0, sizeof(SizeSketch));
+    ssd->threshold_percentile = 0;
     
     ssd->threshold = threshold;
     ssd->capacity = capacity;
@@ -16,27 +27,851 @@ void init_KVSSD(KVSSD *ssd, uint64_t capacity, int page_size, int slab_size, int
     ssd->address_size = 4;  // Default
     ssd->slab_size = slab_size;
     ssd->l2p_ratio = 1;
-    ssd->gmd_len = ssd->tt_pages * ssd->l2p_ratio;
+    ssd->gmd_len = ssd->tt_pages * (double)ssd->l2p_ratio;
 
-    ssd->gmd = malloc(ssd->gmd_len * sizeof(TranslationPage *));
+    // Only the top of the GMD up front, 8 bytes per 4096 slots. calloc gets large blocks
+    // zeroed from the OS, so this costs nothing until slots under an entry are written
+    ssd->gmd_top_len = (ssd->gmd_len + (1ULL << GMD_TOP_SHIFT) - 1) >> GMD_TOP_SHIFT;
+    ssd->gmd = calloc(ssd->gmd_top_len, sizeof(GmdNode *));
     if (ssd->gmd == NULL){
         fprintf(stderr, "Failed to allocate memory for GMD\n");
         exit(1); // Or handle error accordingly
     }
-    for (size_t i = 0; i < ssd->gmd_len; i++) 
-        ssd->gmd[i] = NULL; // self.gmd = [None] * self.gmd_len
+    init_page_pool(&ssd->page_pool, page_size, slab_size, PAGES_PER_REGION);
     
     ssd->max_retry = 8;
-    ssd->rejections = 0;
-    ssd->retries = 0;
-    ssd->read_retries = 0;
-    ssd->read_error = 0;
+    ssd->cuckoo = false;
+    memset(&ssd->counters, 0, sizeof(KVSSDCounters));
+    ssd->i_entry_called = 0;
+
+    ssd->shards = 0;
+    ssd->shard_span = ssd->gmd_len;
+    ssd->shard_locks = NULL;
+    pthread_mutex_init(&ssd->pool_lock, NULL);
+    pthread_mutex_init(&ssd->threshold_lock, NULL);
+    pthread_mutex_init(&ssd->counters_lock, NULL);
+    ssd->threads = NULL;
+
+#ifdef __linux__
+    ssd->gmd_workers = get_nprocs() - 1;
+#else
+    ssd->gmd_workers = 0;
+#endif
+    ssd->workers = NULL;
+    pthread_mutex_init(&ssd->walk_lock, NULL);
+    ssd->instance = __atomic_fetch_add(&next_instance, 1, __ATOMIC_RELAXED);
+
+    ssd->copy_on_write = false;
+    ssd->epoch = 1;
+
+    ssd->snapshot = NULL;
+    ssd->snapshot_bytes = 0;
+    pthread_mutex_init(&ssd->snapshot_lock, NULL);
+
+    ssd->wal = NULL;
+    ssd->lsn = 0;
+    ssd->cache = NULL;
+    ssd->track_latency = false;
+    ssd->latency = NULL;
+    ssd->filter = NULL;
+}
+
+// Like init_KVSSD, but write, read and delete may then be called from many threads at once.
+// The GMD is split into shards ranges of slots with a lock each, and every probe of the retry
+// chain holds only the lock of the page it touches. write_batch writes one op at a time in
+// this mode, and get_stats and clear_KVSSD still need the KVSSD to themselves
+void init_KVSSD_sharded(KVSSD *ssd, uint64_t capacity, int page_size, int slab_size, int threshold, int shards) {
+    init_KVSSD(ssd, capacity, page_size, slab_size, threshold);
+    if (shards < 1)
+        shards = 1;
+    if ((uint64_t)shards > ssd->gmd_len)
+        shards = ssd->gmd_len;
+
+    ssd->shard_span = (ssd->gmd_len + shards - 1) / (uint64_t)shards;
+    ssd->shards = (ssd->gmd_len + ssd->shard_span - 1) / ssd->shard_span;
+    ssd->shard_locks = malloc(ssd->shards * sizeof(pthread_mutex_t));
+    if (ssd->shard_locks == NULL){
+        fprintf(stderr, "Failed to allocate memory for shard locks\n");
+        exit(1);
+    }
+    for (int i = 0; i < ssd->shards; i++)
+        pthread_mutex_init(&ssd->shard_locks[i], NULL);
+}
+
+// Like init_KVSSD_sharded, but read and read_batch never take a lock or wait for a writer.
+// Writers still lock their shard, change a copy of the page and swap the GMD slot over to it.
+// The old page is freed once every reader that might have loaded it has left its epoch
+void init_KVSSD_cow(KVSSD *ssd, uint64_t capacity, int page_size, int slab_size, int threshold, int shards) {
+    init_KVSSD_sharded(ssd, capacity, page_size, slab_size, threshold, shards);
+    ssd->copy_on_write = true;
+}
+
+// Like init_KVSSD, but every key has two pages instead of max_retry probes: the one its hash
+// picks and one picked by a remix of the hash. It is stored under its own hash in either, so
+// a read or delete probes at most two pages. A new key goes to its first page while that has
+// room, so most reads stop there, then to its second. When both are full, entries are moved
+// to their other page (cuckoo displacement, up to CUCKOO_MAX_DEPTH deep) until one of them
+// has a free slab. Single threaded only, write_batch goes one op at a time
+void init_KVSSD_cuckoo(KVSSD *ssd, uint64_t capacity, int page_size, int slab_size, int threshold) {
+    init_KVSSD(ssd, capacity, page_size, slab_size, threshold);
+    ssd->cuckoo = true;
+}
+
+// Frames of init_KVSSD_cached and the backing file behind them
+struct PageCache {
+    FILE *file;
+    size_t page_bytes;
+    char *memory;           // the frames, page_bytes apart
+    uint64_t *slot;         // GMD slot of the page in each frame
+    uint8_t *ref;           // CLOCK reference bits
+    uint8_t *dirty;         // changed since it was last read from or written to the file
+    int frames;
+    int used;               // frames [0, used) hold a page
+    int hand;
+    char *scratch;          // kvssd_stats reads paged out pages here
+    uint64_t accesses;
+    uint64_t misses;
+    uint64_t flash_writes;
+};
+
+// Counting blocked Bloom filter of kvssd_set_filter. A key has one block, a cache line of
+// 128 4-bit counters, and FILTER_HASHES counters in it picked by 7 bit slices of its remixed
+// hash. Counters stop at 15 and stay there, since how many keys they stand for is lost
+struct KeyFilter {
+    uint64_t *words;    // 8 per block, 16 counters per word
+    uint64_t blocks;
+};
+
+// Like init_KVSSD, but only frames translation pages are kept in DRAM, DFTL style. The rest
+// live in a backing file at path (created, or emptied), a page at GMD slot * page_bytes, and
+// are read back when an op needs them. A CLOCK sweep picks the frame to reuse and writes its
+// page back first if it changed. Single threaded only: read_batch and write_batch go one op
+// at a time and kvssd_stats walks on the caller. See kvssd_cache_stats for the traffic
+void init_KVSSD_cached(KVSSD *ssd, uint64_t capacity, int page_size, int slab_size, int threshold, const char *path, int frames) {
+    init_KVSSD(ssd, capacity, page_size, slab_size, threshold);
+    if (frames < 1)
+        frames = 1;
+
+    struct PageCache *c = calloc(1, sizeof(struct PageCache));
+    if (c == NULL || (c->file = fopen(path, "w+b")) == NULL){
+        fprintf(stderr, "Failed to create translation page backing file %s\n", path);
+        exit(1);
+    }
+    setvbuf(c->file, NULL, _IONBF, 0); // one read or write per page
+    c->page_bytes = ssd->page_pool.page_bytes;
+    c->frames = frames;
+    c->memory = aligned_alloc(64, (size_t)frames * c->page_bytes);
+    c->scratch = aligned_alloc(64, c->page_bytes);
+    c->slot = malloc(frames * sizeof(uint64_t));
+    c->ref = calloc(frames, 1);
+    c->dirty = calloc(frames, 1);
+    if (c->memory == NULL || c->scratch == NULL || c->slot == NULL || c->ref == NULL || c->dirty == NULL){
+        fprintf(stderr, "Failed to allocate memory for translation page cache\n");
+        exit(1);
+    }
+    ssd->cache = c;
+    ssd->gmd_workers = 0;
+}
+
+// Takes the lock of the shard holding GMD slot idx (nothing when single threaded)
+static inline void lock_slot(KVSSD *kvssd, uint64_t idx) {
+    if (kvssd->shards)
+        pthread_mutex_lock(&kvssd->shard_locks[idx / kvssd->shard_span]);
+}
+
+static inline void unlock_slot(KVSSD *kvssd, uint64_t idx) {
+    if (kvssd->shards)
+        pthread_mutex_unlock(&kvssd->shard_locks[idx / kvssd->shard_span]);
+}
+
+// update_threshold only changes the KVSSD's threshold. A page picks the new value up here,
+// the next time a writer touches it, so a change costs the same however many pages there are
+static inline TranslationPage *sync_threshold(KVSSD *kvssd, TranslationPage *t_page) {
+    int threshold = __atomic_load_n(&kvssd->threshold, __ATOMIC_RELAXED);
+    if (t_page->threshold != threshold)
+        t_page->threshold = threshold;
+    return t_page;
+}
+
+// Zeroed memory for a GMD node or leaf
+static void *gmd_alloc(size_t size) {
+    void *mem = calloc(1, size);
+    if (mem == NULL){
+        fprintf(stderr, "Failed to allocate memory for GMD\n");
+        exit(1);
+    }
+    return mem;
+}
+
+// Publishes fresh in *ref unless another thread got there first (shards can share a node or
+// leaf), returns whichever is there
+static void *gmd_publish(void **ref, void *fresh) {
+    void *seen = NULL;
+    if (__atomic_compare_exchange_n(ref, &seen, fresh, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return fresh;
+    free(fresh);
+    return seen;
+}
+
+// Address of GMD slot idx, creating its node and leaf if needed
+static TranslationPage **gmd_slot(KVSSD *kvssd, uint64_t idx) {
+    GmdNode **top = &kvssd->gmd[idx >> GMD_TOP_SHIFT];
+    GmdNode *node = __atomic_load_n(top, __ATOMIC_ACQUIRE);
+    if (node == NULL)
+        node = gmd_publish((void **)top, gmd_alloc(sizeof(GmdNode)));
+
+    GmdLeaf **mid = &node->leaves[(idx >> GMD_LEAF_BITS) & ((1 << GMD_NODE_BITS) - 1)];
+    GmdLeaf *leaf = __atomic_load_n(mid, __ATOMIC_ACQUIRE);
+    if (leaf == NULL)
+        leaf = gmd_publish((void **)mid, gmd_alloc(sizeof(GmdLeaf)));
+
+    return &leaf->slots[idx & ((1 << GMD_LEAF_BITS) - 1)];
+}
+
+// Reads or writes the page of GMD slot idx in the backing file
+static void cache_io(struct PageCache *c, uint64_t idx, void *mem, bool out) {
+    if (fseek(c->file, (long)(idx * c->page_bytes), SEEK_SET) != 0
+        || (out ? fwrite(mem, c->page_bytes, 1, c->file) : fread(mem, c->page_bytes, 1, c->file)) != 1){
+        fprintf(stderr, "Failed to %s translation page backing file\n", out ? "write" : "read");
+        exit(1);
+    }
+}
+
+static inline int cache_frame(struct PageCache *c, TranslationPage *t_page) {
+    return ((char *)t_page - c->memory) / c->page_bytes;
+}
+
+// A frame for the page of GMD slot idx. Once every frame is in use, the CLOCK hand passes
+// over recently used ones and pages out the first it finds, writing it back if it is dirty
+static char *cache_take_frame(KVSSD *kvssd, uint64_t idx) {
+    struct PageCache *c = kvssd->cache;
+    int f;
+    if (c->used < c->frames) {
+        f = c->used++;
+    } else {
+        while (c->ref[c->hand]) {
+            c->ref[c->hand] = 0;
+            c->hand = (c->hand + 1) % c->frames;
+        }
+        f = c->hand;
+        c->hand = (c->hand + 1) % c->frames;
+        if (c->dirty[f]) {
+            cache_io(c, c->slot[f], c->memory + (size_t)f * c->page_bytes, true);
+            c->flash_writes++;
+        }
+        *gmd_slot(kvssd, c->slot[f]) = (TranslationPage *)GMD_PAGED_OUT;
+    }
+    c->slot[f] = idx;
+    c->ref[f] = 1;
+    c->dirty[f] = 0;
+    return c->memory + (size_t)f * c->page_bytes;
+}
+
+// Marks that an op used t_page, and changed it if dirty is set
+static inline void cache_touch(KVSSD *kvssd, TranslationPage *t_page, bool dirty) {
+    struct PageCache *c = kvssd->cache;
+    if (c == NULL)
+        return;
+    int f = cache_frame(c, t_page);
+    c->ref[f] = 1;
+    c->dirty[f] |= dirty;
+    c->accesses++;
+}
+
+// Slow path of gmd_page: the page in slot idx was paged out by the cache, or load_KVSSD
+// mapped it and nothing has touched it yet (it still has to be pointed at its own parts
+// inside the mapping). Returns the page now in slot idx
+TranslationPage *gmd_fault(KVSSD *kvssd, uint64_t idx) {
+    TranslationPage **slot = gmd_slot(kvssd, idx);
+    if (kvssd->cache != NULL && *slot == (TranslationPage *)GMD_PAGED_OUT) {
+        char *mem = cache_take_frame(kvssd, idx);
+        cache_io(kvssd->cache, idx, mem, false);
+        kvssd->cache->misses++;
+        *slot = rebase_translation_page(mem);
+        return *slot;
+    }
+
+    pthread_mutex_lock(&kvssd->snapshot_lock);
+    TranslationPage *t_page = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if ((uintptr_t)t_page & GMD_SNAPSHOT_TAG) {
+        t_page = rebase_translation_page((void *)((uintptr_t)t_page & ~(uintptr_t)GMD_SNAPSHOT_TAG));
+        __atomic_store_n(slot, t_page, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&kvssd->snapshot_lock);
+    return t_page;
+}
+
+// Prefetches GMD slot idx if its leaf exists
+static inline void prefetch_slot(KVSSD *kvssd, uint64_t idx) {
+    GmdNode *node = __atomic_load_n(&kvssd->gmd[idx >> GMD_TOP_SHIFT], __ATOMIC_ACQUIRE);
+    if (node == NULL)
+        return;
+    GmdLeaf *leaf = __atomic_load_n(&node->leaves[(idx >> GMD_LEAF_BITS) & ((1 << GMD_NODE_BITS) - 1)], __ATOMIC_ACQUIRE);
+    if (leaf != NULL)
+        __builtin_prefetch(&leaf->slots[idx & ((1 << GMD_LEAF_BITS) - 1)]);
+}
+
+// Returns the page in GMD slot idx, creating it if needed. Caller holds the slot's lock
+static TranslationPage *slot_page(KVSSD *kvssd, uint64_t idx) {
+    TranslationPage **slot = gmd_slot(kvssd, idx);
+    TranslationPage *t_page = *slot;
+    if ((uintptr_t)t_page & (GMD_SNAPSHOT_TAG | GMD_PAGED_OUT))
+        t_page = gmd_fault(kvssd, idx);
+    if (t_page != NULL)
+        return sync_threshold(kvssd, t_page);
+
+    if (kvssd->cache != NULL) {
+        char *mem = cache_take_frame(kvssd, idx);
+        kvssd->cache->dirty[cache_frame(kvssd->cache, (TranslationPage *)mem)] = 1;
+        t_page = init_translation_page(mem, kvssd->page_size, kvssd->slab_size, kvssd->threshold);
+        *slot = t_page;
+        return t_page;
+    }
+
+    if (kvssd->shards)
+        pthread_mutex_lock(&kvssd->pool_lock);
+    t_page = page_pool_alloc(&kvssd->page_pool, __atomic_load_n(&kvssd->threshold, __ATOMIC_RELAXED));
+    if (kvssd->shards)
+        pthread_mutex_unlock(&kvssd->pool_lock);
+
+    // read_batch looks at slots without the lock to prefetch them
+    __atomic_store_n(slot, t_page, __ATOMIC_RELEASE);
+    return t_page;
+}
+
+// State of the calling thread in a sharded KVSSD
+static KVSSDThread *thread_state(KVSSD *kvssd) {
+    if (cached_instance == kvssd->instance)
+        return cached_thread;
+
+    pthread_t self = pthread_self();
+    pthread_mutex_lock(&kvssd->counters_lock);
+    KVSSDThread *t = kvssd->threads;
+    while (t != NULL && !pthread_equal(t->owner, self))
+        t = t->next;
+    if (t == NULL) {
+        t = calloc(1, sizeof(KVSSDThread));
+        if (t == NULL){
+            fprintf(stderr, "Failed to allocate memory for thread state\n");
+            exit(1);
+        }
+        t->owner = self;
+        t->next = kvssd->threads;
+        // Writers walk the list without the lock to check reader epochs
+        __atomic_store_n(&kvssd->threads, t, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&kvssd->counters_lock);
+
+    cached_instance = kvssd->instance;
+    cached_thread = t;
+    return t;
+}
+
+// Counter block of the calling thread
+static KVSSDCounters *thread_counters(KVSSD *kvssd) {
+    if (kvssd->shards == 0)
+        return &kvssd->counters;
+    return &thread_state(kvssd)->counters;
+}
+
+// Adds one to a counter of the calling thread's block, kvssd_counters may read it meanwhile
+static inline void count(int *counter) {
+    __atomic_store_n(counter, *counter + 1, __ATOMIC_RELAXED);
+}
+
+// Histogram bucket of a KVP size: exact below 2 * SIZE_SUB_BUCKETS, then SIZE_SUB_BUCKETS
+// buckets per power of two
+static inline int size_bucket(uint32_t size) {
+    if (size < 2 * SIZE_SUB_BUCKETS)
+        return size;
+    int exp = 31 - __builtin_clz(size);
+    return (exp - 5) * SIZE_SUB_BUCKETS + ((size >> (exp - 6)) & (SIZE_SUB_BUCKETS - 1));
+}
+
+// Smallest size in bucket b, and the number of sizes it holds
+static inline uint32_t bucket_low(int b, uint32_t *width) {
+    if (b < 2 * SIZE_SUB_BUCKETS) {
+        *width = 1;
+        return b;
+    }
+    int exp = b / SIZE_SUB_BUCKETS + 5;
+    *width = 1u << (exp - 6);
+    return (uint32_t)(SIZE_SUB_BUCKETS + b % SIZE_SUB_BUCKETS) << (exp - 6);
+}
+
+static LatencyHistograms *alloc_latency(void) {
+    LatencyHistograms *h = calloc(1, sizeof(LatencyHistograms));
+    if (h == NULL){
+        fprintf(stderr, "Failed to allocate memory for latency histograms\n");
+        exit(1);
+    }
+    return h;
+}
+
+// Histograms the calling thread times into, NULL while latencies are not tracked
+static LatencyHistograms *thread_latency(KVSSD *kvssd) {
+    if (!__atomic_load_n(&kvssd->track_latency, __ATOMIC_RELAXED))
+        return NULL;
+    if (kvssd->shards == 0)
+        return kvssd->latency;
+    KVSSDThread *t = thread_state(kvssd);
+    if (t->latency == NULL)
+        __atomic_store_n(&t->latency, alloc_latency(), __ATOMIC_RELEASE); // kvssd_latency may be reading the list
+    return t->latency;
+}
+
+// Only the owning thread adds to a block, so like count() these are plain stores that
+// kvssd_latency may read meanwhile
+static inline void add_latency(LatencyHistograms *h, int path, uint64_t ns) {
+    uint64_t *bucket = &h->counts[path][size_bucket(ns > LATENCY_MAX_NS ? LATENCY_MAX_NS : (uint32_t)ns)];
+    __atomic_store_n(bucket, *bucket + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->n[path], h->n[path] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->sum[path], h->sum[path] + ns, __ATOMIC_RELAXED);
+    if (ns > h->max[path])
+        __atomic_store_n(&h->max[path], ns, __ATOMIC_RELAXED);
+}
+
+// Moves the calling reader into the current epoch. Pages it loads from the GMD until
+// exit_epoch stay allocated even if a writer replaces them meanwhile
+static KVSSDThread *enter_epoch(KVSSD *kvssd) {
+    KVSSDThread *self = thread_state(kvssd);
+    __atomic_store_n(&self->epoch, __atomic_load_n(&kvssd->epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return self;
+}
+
+static inline void exit_epoch(KVSSDThread *self) {
+    __atomic_store_n(&self->epoch, 0, __ATOMIC_RELEASE);
+}
+
+// Moves the global epoch on if every reader has caught up with it
+static void try_advance_epoch(KVSSD *kvssd) {
+    uint64_t epoch = __atomic_load_n(&kvssd->epoch, __ATOMIC_SEQ_CST);
+    for (KVSSDThread *t = __atomic_load_n(&kvssd->threads, __ATOMIC_ACQUIRE); t != NULL; t = t->next) {
+        uint64_t reading = __atomic_load_n(&t->epoch, __ATOMIC_SEQ_CST);
+        if (reading != 0 && reading != epoch)
+            return;
+    }
+    __atomic_compare_exchange_n(&kvssd->epoch, &epoch, epoch + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+// Frees the calling thread's retired pages that no reader can still hold: a page replaced in
+// epoch e was unreachable before the epoch reached e + 1, and the epoch only reaches e + 2
+// once every reader has moved into e + 1 or left
+static void reclaim_pages(KVSSD *kvssd, KVSSDThread *self) {
+    try_advance_epoch(kvssd);
+    uint64_t epoch = __atomic_load_n(&kvssd->epoch, __ATOMIC_SEQ_CST);
+
+    int kept = 0;
+    pthread_mutex_lock(&kvssd->pool_lock);
+    for (int i = 0; i < self->retired_count; i++) {
+        if (self->retired[i].epoch + 2 <= epoch)
+            page_pool_free(&kvssd->page_pool, self->retired[i].page);
+        else
+            self->retired[kept++] = self->retired[i];
+    }
+    pthread_mutex_unlock(&kvssd->pool_lock);
+    self->retired_count = kept;
+}
+
+// Queues a page a copy-on-write writer just replaced for freeing
+static void retire_page(KVSSD *kvssd, TranslationPage *t_page) {
+    KVSSDThread *self = thread_state(kvssd);
+    if (self->retired_count == self->retired_cap) {
+        int cap = self->retired_cap ? self->retired_cap * 2 : 2 * RETIRE_BATCH;
+        RetiredPage *retired = realloc(self->retired, cap * sizeof(RetiredPage));
+        if (retired == NULL){
+            fprintf(stderr, "Failed to allocate memory for retired pages\n");
+            exit(1);
+        }
+        self->retired = retired;
+        self->retired_cap = cap;
+    }
+    self->retired[self->retired_count].page = t_page;
+    self->retired[self->retired_count].epoch = __atomic_load_n(&kvssd->epoch, __ATOMIC_SEQ_CST);
+    self->retired_count++;
+
+    if (self->retired_count % RETIRE_BATCH == 0)
+        reclaim_pages(kvssd, self);
+}
+
+// Page a writer of GMD slot idx changes, creating it if needed. In copy-on-write mode that is
+// a private copy which end_update publishes. Caller holds the slot's lock
+static TranslationPage *begin_update(KVSSD *kvssd, uint64_t idx) {
+    if (!kvssd->copy_on_write)
+        return slot_page(kvssd, idx);
+
+    TranslationPage *t_page = gmd_page(kvssd, idx);
+    pthread_mutex_lock(&kvssd->pool_lock);
+    if (t_page == NULL)
+        t_page = page_pool_alloc(&kvssd->page_pool, __atomic_load_n(&kvssd->threshold, __ATOMIC_RELAXED));
+    else
+        t_page = page_pool_copy(&kvssd->page_pool, t_page);
+    pthread_mutex_unlock(&kvssd->pool_lock);
+    return sync_threshold(kvssd, t_page);
+}
+
+// Makes the page begin_update returned the one readers see
+static void end_update(KVSSD *kvssd, uint64_t idx, TranslationPage *t_page) {
+    if (!kvssd->copy_on_write)
+        return;
+
+    TranslationPage **slot = gmd_slot(kvssd, idx);
+    TranslationPage *old = *slot;
+    __atomic_store_n(slot, t_page, __ATOMIC_SEQ_CST);
+    if (old != NULL)
+        retire_page(kvssd, old);
+}
+
+// Cache traffic so far, all zero unless the KVSSD came from init_KVSSD_cached
+KVSSDCacheStats kvssd_cache_stats(KVSSD *kvssd) {
+    KVSSDCacheStats st;
+    memset(&st, 0, sizeof(KVSSDCacheStats));
+    struct PageCache *c = kvssd->cache;
+    if (c != NULL) {
+        st.accesses = c->accesses;
+        st.misses = c->misses;
+        st.flash_writes = c->flash_writes;
+        st.frames = c->frames;
+        st.resident = c->used;
+    }
+    return st;
+}
+
+// Starts or stops timing write, read and delete per path (see LAT_WRITE and the rest). Off
+// by default, when it costs a branch per op. Latencies recorded so far stay, clear_KVSSD
+// drops them. read_batch and write_batch are not timed per key
+void kvssd_track_latency(KVSSD *kvssd, bool on) {
+    if (on && kvssd->latency == NULL)
+        kvssd->latency = alloc_latency();
+    __atomic_store_n(&kvssd->track_latency, on, __ATOMIC_RELAXED);
+}
+
+// Count, mean, percentiles (to within a bucket) and max of path, over every thread
+LatencySummary kvssd_latency(KVSSD *kvssd, int path) {
+    uint64_t counts[SIZE_BUCKETS];
+    LatencySummary s;
+    memset(&s, 0, sizeof(LatencySummary));
+    if (path < 0 || path >= LATENCY_PATHS)
+        return s;
+
+    memset(counts, 0, sizeof(counts));
+    uint64_t sum = 0;
+    pthread_mutex_lock(&kvssd->counters_lock);
+    KVSSDThread *t = kvssd->threads;
+    for (LatencyHistograms *h = kvssd->latency; ; h = __atomic_load_n(&t->latency, __ATOMIC_ACQUIRE), t = t->next) {
+        if (h != NULL) {
+            for (int b = 0; b < SIZE_BUCKETS; b++)
+                counts[b] += __atomic_load_n(&h->counts[path][b], __ATOMIC_RELAXED);
+            s.count += __atomic_load_n(&h->n[path], __ATOMIC_RELAXED);
+            sum += __atomic_load_n(&h->sum[path], __ATOMIC_RELAXED);
+            uint64_t max = __atomic_load_n(&h->max[path], __ATOMIC_RELAXED);
+            s.max = max > s.max ? max : s.max;
+        }
+        if (t == NULL)
+            break;
+    }
+    pthread_mutex_unlock(&kvssd->counters_lock);
+
+    if (s.count > 0) {
+        s.mean = (double)sum / s.count;
+        double pct[3] = {0.5, 0.99, 0.999};
+        uint64_t *out[3] = {&s.p50, &s.p99, &s.p999};
+        uint64_t seen = 0;
+        int q = 0;
+        for (int b = 0; b < SIZE_BUCKETS && q < 3; b++) {
+            seen += counts[b];
+            while (q < 3 && seen >= (uint64_t)ceil(pct[q] * s.count)) {
+                uint32_t width, low = bucket_low(b, &width);
+                uint64_t v = low + (width - 1) / 2;
+                *out[q++] = v < s.max ? v : s.max;
+            }
+        }
+    }
+    return s;
+}
+
+const char *latency_path_name(int path) {
+    static const char *names[LATENCY_PATHS] = {
+        "write", "write d_entry", "write i_entry", "write eviction", "write plain", "write threshold",
+        "write first_try", "write retry_1", "write retry_2+", "write rejected",
+        "read", "read d_entry", "read i_entry", "read miss", "read first_try", "read retry_1", "read retry_2+",
+        "delete", "delete d_entry", "delete i_entry", "delete miss", "delete first_try", "delete retry_1", "delete retry_2+",
+    };
+    return path >= 0 && path < LATENCY_PATHS ? names[path] : "?";
+}
+
+// Counters of every thread added up
+KVSSDCounters kvssd_counters(KVSSD *kvssd) {
+    KVSSDCounters total = kvssd->counters;
+
+    pthread_mutex_lock(&kvssd->counters_lock);
+    for (KVSSDThread *t = kvssd->threads; t != NULL; t = t->next) {
+        KVSSDCounters *c = &t->counters;
+        total.rejections += __atomic_load_n(&c->rejections, __ATOMIC_RELAXED);
+        total.retries += __atomic_load_n(&c->retries, __ATOMIC_RELAXED);
+        total.read_retries += __atomic_load_n(&c->read_retries, __ATOMIC_RELAXED);
+        total.read_error += __atomic_load_n(&c->read_error, __ATOMIC_RELAXED);
+        total.read_d_entry += __atomic_load_n(&c->read_d_entry, __ATOMIC_RELAXED);
+        total.read_i_entry += __atomic_load_n(&c->read_i_entry, __ATOMIC_RELAXED);
+        total.relocations += __atomic_load_n(&c->relocations, __ATOMIC_RELAXED);
+        total.filter_negatives += __atomic_load_n(&c->filter_negatives, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&kvssd->counters_lock);
+    return total;
+}
+
+// A parallel walk cuts [0, n) into chunks of GMD_CHUNK items (more for large n, see
+// chunk_size), which the calling thread and the workers take in turn until none are left
+typedef void (*chunk_fn)(KVSSD *kvssd, int chunk, uint64_t start, uint64_t end, void *ctx);
+
+static uint64_t chunk_size(uint64_t n) {
+    uint64_t size = GMD_CHUNK;
+    while ((n + size - 1) / size > GMD_MAX_CHUNKS)
+        size *= 2;
+    return size;
+}
+
+struct GmdWorkers {
+    int count;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t start;  // a walk was posted, or quit was set
+    pthread_cond_t done;   // the last worker finished its part of the walk
+    uint64_t walk;         // walks posted so far
+    int running;           // workers still in the current walk
+    bool quit;
+
+    // Current walk
+    KVSSD *kvssd;
+    chunk_fn fn;
+    void *ctx;
+    uint64_t n;
+    uint64_t chunk;
+    int next_chunk;
+};
+
+static void run_chunks(struct GmdWorkers *w) {
+    int chunks = (w->n + w->chunk - 1) / w->chunk;
+    for (int c; (c = __atomic_fetch_add(&w->next_chunk, 1, __ATOMIC_RELAXED)) < chunks; ) {
+        uint64_t start = c * w->chunk;
+        w->fn(w->kvssd, c, start, w->n - start < w->chunk ? w->n : start + w->chunk, w->ctx);
+    }
+}
+
+static void *gmd_worker(void *arg) {
+    struct GmdWorkers *w = arg;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->quit && w->walk == seen)
+            pthread_cond_wait(&w->start, &w->lock);
+        if (w->quit)
+            break;
+        seen = w->walk;
+        pthread_mutex_unlock(&w->lock);
+
+        run_chunks(w);
+
+        pthread_mutex_lock(&w->lock);
+        if (--w->running == 0)
+            pthread_cond_signal(&w->done);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+static struct GmdWorkers *start_workers(int count) {
+    struct GmdWorkers *w = calloc(1, sizeof(struct GmdWorkers));
+    if (w != NULL)
+        w->threads = malloc(count * sizeof(pthread_t));
+    if (w == NULL || w->threads == NULL){
+        fprintf(stderr, "Failed to allocate memory for GMD workers\n");
+        exit(1);
+    }
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->start, NULL);
+    pthread_cond_init(&w->done, NULL);
+    for (int i = 0; i < count; i++) {
+        if (pthread_create(&w->threads[i], NULL, gmd_worker, w) != 0){
+            fprintf(stderr, "Failed to start GMD workers\n");
+            exit(1);
+        }
+    }
+    w->count = count;
+    return w;
+}
+
+static void stop_workers(struct GmdWorkers *w) {
+    pthread_mutex_lock(&w->lock);
+    w->quit = true;
+    pthread_cond_broadcast(&w->start);
+    pthread_mutex_unlock(&w->lock);
+    for (int i = 0; i < w->count; i++)
+        pthread_join(w->threads[i], NULL);
+
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->start);
+    pthread_cond_destroy(&w->done);
+    free(w->threads);
+    free(w);
+}
+
+// Number of threads besides the caller that walk the GMD for kvssd_stats, and so for get_stats
+// and kvssd_set_filter. init_KVSSD picks one less than the number of CPUs, 0 walks on the
+// calling thread only
+void set_gmd_workers(KVSSD *kvssd, int workers) {
+    pthread_mutex_lock(&kvssd->walk_lock);
+    if (kvssd->workers != NULL) {
+        stop_workers(kvssd->workers);
+        kvssd->workers = NULL;
+    }
+    kvssd->gmd_workers = workers < 0 || kvssd->cache != NULL ? 0 : workers; // one backing file reader
+    pthread_mutex_unlock(&kvssd->walk_lock);
+}
+
+// Calls fn on every chunk of [0, n) and returns once all of them are done
+static void parallel_chunks(KVSSD *kvssd, uint64_t n, chunk_fn fn, void *ctx) {
+    uint64_t chunk = chunk_size(n);
+    if (kvssd->gmd_workers == 0 || n <= chunk) {
+        int c = 0;
+        for (uint64_t start = 0; start < n; c++, start += chunk)
+            fn(kvssd, c, start, n - start < chunk ? n : start + chunk, ctx);
+        return;
+    }
+
+    pthread_mutex_lock(&kvssd->walk_lock);
+    if (kvssd->workers == NULL)
+        kvssd->workers = start_workers(kvssd->gmd_workers);
+    struct GmdWorkers *w = kvssd->workers;
+
+    pthread_mutex_lock(&w->lock);
+    w->kvssd = kvssd;
+    w->fn = fn;
+    w->ctx = ctx;
+    w->n = n;
+    w->chunk = chunk;
+    w->next_chunk = 0;
+    w->running = w->count;
+    w->walk++;
+    pthread_cond_broadcast(&w->start);
+    pthread_mutex_unlock(&w->lock);
+
+    run_chunks(w);
+
+    pthread_mutex_lock(&w->lock);
+    while (w->running > 0)
+        pthread_cond_wait(&w->done, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+    pthread_mutex_unlock(&kvssd->walk_lock);
+}
+
+// Empties the KVSSD, its translation pages go back to the page pool for the next writes
+void clear_KVSSD(KVSSD *ssd) {
+    // Nodes and leaves stay for the next writes
+    for (uint64_t t = 0; t < ssd->gmd_top_len; t++) {
+        if (ssd->gmd[t] == NULL)
+            continue;
+        for (int l = 0; l < 1 << GMD_NODE_BITS; l++) {
+            GmdLeaf *leaf = ssd->gmd[t]->leaves[l];
+            if (leaf == NULL)
+                continue;
+            for (int s = 0; s < 1 << GMD_LEAF_BITS; s++) {
+                if (leaf->slots[s] == NULL)
+                    continue;
+                // Snapshot pages are rebuilt from scratch when the pool hands them out again
+                if (ssd->cache == NULL)
+                    page_pool_free(&ssd->page_pool, (TranslationPage *)((uintptr_t)leaf->slots[s] & ~(uintptr_t)GMD_SNAPSHOT_TAG));
+                leaf->slots[s] = NULL;
+            }
+        }
+    }
+
+    ssd->curr_iteration = 0;
+    memset(&ssd->kv_sizes, 0, sizeof(SizeSketch));
+    memset(&ssd->counters, 0, sizeof(KVSSDCounters));
+    if (ssd->latency != NULL)
+        memset(ssd->latency, 0, sizeof(LatencyHistograms));
+    for (KVSSDThread *t = ssd->threads; t != NULL; t = t->next) {
+        memset(&t->counters, 0, sizeof(KVSSDCounters));
+        if (t->latency != NULL)
+            memset(t->latency, 0, sizeof(LatencyHistograms));
+        for (int i = 0; i < t->retired_count; i++)
+            page_pool_free(&ssd->page_pool, t->retired[i].page);
+        t->retired_count = 0;
+    }
     ssd->i_entry_called = 0;
+    if (ssd->filter != NULL)
+        memset(ssd->filter->words, 0, ssd->filter->blocks * 64);
+
+    struct PageCache *c = ssd->cache;
+    if (c != NULL) {
+        c->used = 0;
+        c->hand = 0;
+        c->accesses = 0;
+        c->misses = 0;
+        c->flash_writes = 0;
+    }
+}
+
+// Releases all memory owned by the KVSSD (but not the KVSSD struct itself)
+void free_KVSSD(KVSSD *ssd) {
+    kvssd_close_wal(ssd);
+    set_gmd_workers(ssd, 0);
+    pthread_mutex_destroy(&ssd->walk_lock);
+    destroy_page_pool(&ssd->page_pool);
+    for (uint64_t t = 0; t < ssd->gmd_top_len; t++) {
+        if (ssd->gmd[t] == NULL)
+            continue;
+        for (int l = 0; l < 1 << GMD_NODE_BITS; l++)
+            free(ssd->gmd[t]->leaves[l]);
+        free(ssd->gmd[t]);
+    }
+    free(ssd->gmd);
+    ssd->gmd = NULL;
+
+    while (ssd->threads != NULL) {
+        KVSSDThread *t = ssd->threads;
+        ssd->threads = t->next;
+        free(t->retired);
+        free(t->latency);
+        free(t);
+    }
+    for (int i = 0; i < ssd->shards; i++)
+        pthread_mutex_destroy(&ssd->shard_locks[i]);
+    free(ssd->shard_locks);
+    ssd->shard_locks = NULL;
+    ssd->shards = 0;
+    free(ssd->latency);
+    ssd->latency = NULL;
+    ssd->track_latency = false;
+    kvssd_set_filter(ssd, 0);
+    pthread_mutex_destroy(&ssd->pool_lock);
+    pthread_mutex_destroy(&ssd->threshold_lock);
+    pthread_mutex_destroy(&ssd->counters_lock);
+
+    if (ssd->cache != NULL) {
+        fclose(ssd->cache->file);
+        free(ssd->cache->memory);
+        free(ssd->cache->scratch);
+        free(ssd->cache->slot);
+        free(ssd->cache->ref);
+        free(ssd->cache->dirty);
+        free(ssd->cache);
+        ssd->cache = NULL;
+    }
+
+    // After the pool, its free list may run through the mapping
+    if (ssd->snapshot != NULL)
+        munmap(ssd->snapshot, ssd->snapshot_bytes);
+    ssd->snapshot = NULL;
+    pthread_mutex_destroy(&ssd->snapshot_lock);
 }
 
 // returns size of gmd in MB
 int gmd_size(KVSSD *kvssd) {
-    return (kvssd->tt_pages * kvssd->address_size) / (1024 * 1024);
+    return (kvssd->tt_pages * kvssd->address_size) / (1024 * 1024); // of a flat GMD
 }
 
 // returns murmurhash 64B version 
@@ -47,203 +882,1503 @@ uint64_t hash_k(const char *key) {
     return hash;  
 }
 
+// Same hashes as hash_k for n keys whose lengths are already known, several keys per
+// SIMD step when the CPU has AVX-512
+void hash_k_batch(const char *const *keys, const int *lens, int n, uint64_t *out) {
+    uint32_t seed = 42;
+    MurmurHash3_x64_64_batch(keys, lens, n, seed, out);
+}
+
 // Returns index of translation page
-int get_translation_page(KVSSD *ssd, uint64_t key_hash) {
+uint64_t get_translation_page(KVSSD *ssd, uint64_t key_hash) {
     return key_hash % ssd->gmd_len;
 }
 
-bool write(KVSSD *kvssd, const char *key, int val, int klen, int vlen) {
-    uint64_t key_hash = hash_k(key);
+// Murmur3's finalizer, for a second hash of a key that doesn't share the bits of key_hash
+// get_translation_page used
+static inline uint64_t remix_hash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
 
-    // Logic for updating the threshold based on the average kvp size
-    kvssd->kvp_sizes[kvssd->curr_iteration] = klen + vlen;
+// Second page of key_hash under cuckoo placement, never the first one unless the GMD has a
+// single slot
+static uint64_t cuckoo_page(KVSSD *ssd, uint64_t key_hash) {
+    if (ssd->gmd_len < 2)
+        return 0;
+    uint64_t h = remix_hash(key_hash);
+    uint64_t first = get_translation_page(ssd, key_hash);
+    uint64_t idx = h % (ssd->gmd_len - 1);
+    return idx >= first ? idx + 1 : idx;
+}
+
+// GMD slot of probe i of key_hash, and in *stored the hash the key is kept under there:
+// retry i of the quadratic sequence, or with cuckoo placement the key's first or second page
+static inline uint64_t probe_page(KVSSD *kvssd, uint64_t key_hash, int i, uint64_t *stored) {
+    if (kvssd->cuckoo) {
+        *stored = key_hash;
+        return i == 0 ? get_translation_page(kvssd, key_hash) : cuckoo_page(kvssd, key_hash);
+    }
+    *stored = key_hash + i * i;
+    return get_translation_page(kvssd, *stored);
+}
+
+static inline int probe_count(KVSSD *kvssd) {
+    return kvssd->cuckoo ? 2 : kvssd->max_retry;
+}
+
+// Block of key_hash, and its counter numbers in *bits (7 bits each, lowest first)
+static inline uint64_t *filter_block(struct KeyFilter *f, uint64_t key_hash, uint64_t *bits) {
+    *bits = remix_hash(key_hash);
+    return f->words + (uint64_t)(((unsigned __int128)key_hash * f->blocks) >> 64) * 8;
+}
+
+static inline void prefetch_filter(KVSSD *kvssd, uint64_t key_hash) {
+    uint64_t bits;
+    if (kvssd->filter != NULL)
+        __builtin_prefetch(filter_block(kvssd->filter, key_hash, &bits));
+}
+
+// False if the KVSSD certainly has no entry for key_hash (the hash of the key, before any
+// retry offset), always true without a filter
+static inline bool filter_may_contain(KVSSD *kvssd, uint64_t key_hash) {
+    struct KeyFilter *f = kvssd->filter;
+    if (f == NULL)
+        return true;
+    uint64_t bits;
+    uint64_t *block = filter_block(f, key_hash, &bits);
+    for (int i = 0; i < FILTER_HASHES; i++, bits >>= 7) {
+        int c = bits & 127;
+        if (((__atomic_load_n(&block[c >> 4], __ATOMIC_RELAXED) >> (c & 15) * 4) & 15) == 0)
+            return false;
+    }
+    return true;
+}
+
+// Counts an entry of key_hash in (delta 1) or out (-1) of the filter. Sharded writers of
+// different shards can share a word, so they update it with a CAS
+static void filter_update(KVSSD *kvssd, uint64_t key_hash, int delta) {
+    struct KeyFilter *f = kvssd->filter;
+    if (f == NULL)
+        return;
+    uint64_t bits;
+    uint64_t *block = filter_block(f, key_hash, &bits);
+    for (int i = 0; i < FILTER_HASHES; i++, bits >>= 7) {
+        int c = bits & 127, shift = (c & 15) * 4;
+        uint64_t *w = &block[c >> 4];
+        uint64_t old = __atomic_load_n(w, __ATOMIC_RELAXED), next;
+        do {
+            uint64_t n = (old >> shift) & 15;
+            if (n == 15 || (n == 0 && delta < 0))
+                break;
+            next = delta > 0 ? old + (1ULL << shift) : old - (1ULL << shift);
+            if (!kvssd->shards) {
+                *w = next;
+                break;
+            }
+        } while (!__atomic_compare_exchange_n(w, &old, next, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    }
+}
+
+// Puts a counting blocked Bloom filter of bytes (rounded up to a cache line) in front of read,
+// read_batch and delete, so most lookups of a key the KVSSD doesn't hold read one cache line
+// instead of probing every page of the retry chain. It counts entries under the key's own
+// hash: a write that creates one adds it and a delete takes it out, while D-entry/I-entry
+// conversions, evictions and cuckoo moves keep the entry and leave the filter alone. An
+// I-entry doesn't record which retry it was written at, so the filter can't be built from the
+// pages: false, and no filter, if the KVSSD already holds keys. 0 bytes drops the filter. Not
+// while other threads use the KVSSD
+bool kvssd_set_filter(KVSSD *kvssd, uint64_t bytes) {
+    if (bytes > 0 && kvssd_stats(kvssd).keys > 0)
+        return false;
+    if (kvssd->filter != NULL) {
+        free(kvssd->filter->words);
+        free(kvssd->filter);
+        kvssd->filter = NULL;
+    }
+    if (bytes == 0)
+        return true;
+
+    struct KeyFilter *f = malloc(sizeof(struct KeyFilter));
+    if (f != NULL) {
+        f->blocks = (bytes + 63) / 64;
+        f->words = aligned_alloc(64, f->blocks * 64);
+    }
+    if (f == NULL || f->words == NULL){
+        fprintf(stderr, "Failed to allocate memory for key filter\n");
+        exit(1);
+    }
+    memset(f->words, 0, f->blocks * 64);
+    kvssd->filter = f;
+    return true;
+}
+
+// A read the filter turned away, a miss like any other as far as the counters go
+static bool filter_miss(KVSSD *kvssd) {
+    KVSSDCounters *c = thread_counters(kvssd);
+    count(&c->filter_negatives);
+    count(&c->read_error);
+    return false;
+}
+
+// Adds one KVP size to the histogram update_threshold reads
+static void add_kv_size(KVSSD *kvssd, int size) {
+    uint32_t s = size < 0 ? 0 : size;
+    SizeSketch *sk = &kvssd->kv_sizes;
+    if (kvssd->shards) {
+        __atomic_fetch_add(&sk->counts[size_bucket(s)], 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&sk->n, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&sk->sum, s, __ATOMIC_RELAXED);
+        return;
+    }
+    sk->counts[size_bucket(s)]++;
+    sk->n++;
+    sk->sum += s;
+}
+
+// Moves the sizes recorded so far into round and starts an empty histogram. In sharded mode
+// sizes recorded meanwhile land in one round or the next, never in both
+static void take_kv_sizes(KVSSD *kvssd, SizeSketch *round) {
+    SizeSketch *sk = &kvssd->kv_sizes;
+    if (kvssd->shards) {
+        for (int b = 0; b < SIZE_BUCKETS; b++)
+            round->counts[b] = __atomic_exchange_n(&sk->counts[b], 0, __ATOMIC_RELAXED);
+        round->n = __atomic_exchange_n(&sk->n, 0, __ATOMIC_RELAXED);
+        round->sum = __atomic_exchange_n(&sk->sum, 0, __ATOMIC_RELAXED);
+        return;
+    }
+    *round = *sk;
+    memset(sk, 0, sizeof(SizeSketch));
+}
+
+// Mean in whole bytes, which is what the threshold has always been computed from
+static double sketch_mean(const SizeSketch *sk) {
+    return sk->n == 0 ? 0 : (double)(sk->sum / sk->n);
+}
+
+// Size below which percentile % of the sizes fall, to within a bucket
+static int sketch_percentile(const SizeSketch *sk, double percentile) {
+    uint64_t n = 0;
+    for (int b = 0; b < SIZE_BUCKETS; b++)
+        n += sk->counts[b];
+    if (n == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)ceil(percentile / 100 * n);
+    if (rank < 1)
+        rank = 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < SIZE_BUCKETS; b++) {
+        seen += sk->counts[b];
+        if (seen >= rank) {
+            uint32_t width, low = bucket_low(b, &width);
+            return low + (width - 1) / 2;
+        }
+    }
+    return 0;
+}
+
+// One logged write or delete, followed by key_len bytes of key and padding to 8 bytes
+typedef struct {
+    uint64_t lsn;       // above the lsn of every record before it
+    uint64_t key_hash;
+    int val;
+    int klen;
+    int vlen;
+    uint32_t key_len;
+    uint32_t op;        // WAL_WRITE or WAL_DELETE
+    uint32_t pad;
+    uint64_t check;     // see wal_check
+} WalRecord;
+
+// Log of a KVSSD, see kvssd_open_wal. Writers fill buf, the flusher swaps it with spare and
+// writes the whole group with one write to a file opened O_DSYNC
+struct Wal {
+    FILE *file;
+    char *buf;
+    char *spare;
+    size_t used;             // bytes in buf
+    int pending;             // records in buf
+    uint64_t first_ns;       // when the oldest record in buf was logged
+    uint64_t next_lsn;
+    uint64_t chain;          // check of the last record logged
+    uint64_t durable_lsn;    // every record up to here is on disk
+    int batch;
+    uint64_t interval_ns;
+    bool wait;
+    int hurry;               // threads waiting for buffer space or in kvssd_sync_wal
+    bool stop;
+    bool failed;
+    pthread_t flusher;
+    pthread_mutex_t lock;
+    pthread_cond_t work;     // records were logged, or stop was set
+    pthread_cond_t done;     // buf was swapped out or durable_lsn moved
+};
+
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Checksum of a record and its key, chained to the record before it. Replay stops at the
+// first record that fails it, so at a torn write, and never goes on into records left past
+// the end of the log from before it was last reopened
+static uint64_t wal_check(WalRecord *rec, const char *key, uint64_t prev) {
+    rec->check = prev;
+    uint64_t h = MurmurHash3_x64_64(rec, sizeof(WalRecord), 0);
+    return h ^ MurmurHash3_x64_64(key, rec->key_len, (uint32_t)(h >> 32));
+}
+
+// Logs a write or delete ahead of applying it. Returns its lsn, 0 when there is no log
+static uint64_t wal_append(KVSSD *kvssd, uint32_t op, const char *key, uint64_t key_hash, int val, int klen, int vlen) {
+    struct Wal *wal = kvssd->wal;
+    if (wal == NULL)
+        return 0;
+
+    WalRecord rec;
+    memset(&rec, 0, sizeof(WalRecord));
+    rec.key_hash = key_hash;
+    rec.val = val;
+    rec.klen = klen;
+    rec.vlen = vlen;
+    rec.key_len = strlen(key);
+    rec.op = op;
+    size_t size = (sizeof(WalRecord) + rec.key_len + 7) & ~(size_t)7;
+    if (size > WAL_BUFFER){
+        fprintf(stderr, "Key too long for the write-ahead log\n");
+        exit(1);
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    while (wal->used + size > WAL_BUFFER) {
+        wal->hurry++;
+        pthread_cond_signal(&wal->work);
+        pthread_cond_wait(&wal->done, &wal->lock);
+        wal->hurry--;
+    }
+    rec.lsn = wal->next_lsn++;
+    rec.check = wal->chain = wal_check(&rec, key, wal->chain);
+    char *out = wal->buf + wal->used;
+    memcpy(out, &rec, sizeof(WalRecord));
+    memcpy(out + sizeof(WalRecord), key, rec.key_len);
+    memset(out + sizeof(WalRecord) + rec.key_len, 0, size - sizeof(WalRecord) - rec.key_len);
+    wal->used += size;
+    if (wal->pending++ == 0) {
+        wal->first_ns = clock_ns();
+        pthread_cond_signal(&wal->work);
+    } else if (wal->pending == wal->batch) {
+        pthread_cond_signal(&wal->work);
+    }
+    kvssd->lsn = rec.lsn;
+    pthread_mutex_unlock(&wal->lock);
+    return rec.lsn;
+}
+
+// In wait mode, returns once the record with lsn is on disk
+static void wal_wait(KVSSD *kvssd, uint64_t lsn) {
+    struct Wal *wal = kvssd->wal;
+    if (lsn == 0 || !wal->wait)
+        return;
+    pthread_mutex_lock(&wal->lock);
+    while (wal->durable_lsn < lsn && !wal->failed)
+        pthread_cond_wait(&wal->done, &wal->lock);
+    pthread_mutex_unlock(&wal->lock);
+}
+
+// Group commit: waits until batch records are buffered or the oldest has waited interval_ns,
+// then writes them all at once
+static void *wal_flusher(void *arg) {
+    struct Wal *wal = arg;
+    pthread_mutex_lock(&wal->lock);
+    for (;;) {
+        while (wal->pending == 0 && !wal->stop)
+            pthread_cond_wait(&wal->work, &wal->lock);
+        if (wal->pending == 0)
+            break;
+
+        uint64_t deadline = wal->first_ns + wal->interval_ns;
+        while (wal->pending < wal->batch && !wal->stop && wal->hurry == 0 && clock_ns() < deadline) {
+            struct timespec ts = {deadline / 1000000000ULL, deadline % 1000000000ULL};
+            pthread_cond_timedwait(&wal->work, &wal->lock, &ts);
+        }
+
+        char *out = wal->buf;
+        size_t bytes = wal->used;
+        uint64_t last = wal->next_lsn - 1;
+        wal->buf = wal->spare;
+        wal->spare = out;
+        wal->used = 0;
+        wal->pending = 0;
+        if (wal->hurry)
+            pthread_cond_broadcast(&wal->done);
+        pthread_mutex_unlock(&wal->lock);
+
+        bool ok = fwrite(out, 1, bytes, wal->file) == bytes;
+
+        pthread_mutex_lock(&wal->lock);
+        if (!ok && !wal->failed) {
+            fprintf(stderr, "Failed to write the write-ahead log\n");
+            wal->failed = true;
+        }
+        wal->durable_lsn = last;
+        pthread_cond_broadcast(&wal->done);
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return NULL;
+}
+
+// How an op went, for the latency splits. Only filled in while latencies are tracked
+typedef struct {
+    int depth;          // retry the key was written or found at, -1 if it never was
+    uint8_t type;       // D_ENTRY or I_ENTRY it is in (or was, for a delete)
+    bool eviction;
+    bool threshold;
+} OpPath;
+
+// Times an op that started at t0 into its total (op) and the splits path puts it in. The
+// splits of each op follow its total in the order of the enum
+static void time_op(LatencyHistograms *h, int op, uint64_t t0, const OpPath *path) {
+    uint64_t ns = clock_ns() - t0;
+    add_latency(h, op, ns);
+    if (path->depth < 0) {
+        add_latency(h, op == LAT_WRITE ? LAT_WRITE_REJECTED : op == LAT_READ ? LAT_READ_MISS : LAT_DELETE_MISS, ns);
+    } else {
+        add_latency(h, op + (path->type == D_ENTRY ? 1 : 2), ns);
+        int depth = path->depth < 2 ? path->depth : 2;
+        int first_try = op == LAT_WRITE ? LAT_WRITE_FIRST_TRY : op == LAT_READ ? LAT_READ_FIRST_TRY : LAT_DELETE_FIRST_TRY;
+        add_latency(h, first_try + depth, ns);
+    }
+    if (op == LAT_WRITE) {
+        if (path->depth >= 0)
+            add_latency(h, path->eviction ? LAT_WRITE_EVICTION : LAT_WRITE_PLAIN, ns);
+        if (path->threshold)
+            add_latency(h, LAT_WRITE_THRESHOLD, ns);
+    }
+}
+
+// Records the size of a new KVP, updating the threshold every max_iterations KVPs. Returns
+// whether the write ran update_threshold
+static bool record_kvp_size(KVSSD *kvssd, int klen, int vlen) {
+    if (kvssd->shards) {
+        // Every thread takes a ticket, and the one that completes a round of max_iterations
+        // updates the threshold and takes the round back off the counter
+        int t = __atomic_fetch_add(&kvssd->curr_iteration, 1, __ATOMIC_RELAXED);
+        add_kv_size(kvssd, klen + vlen);
+        if ((t + 1) % kvssd->max_iterations == 0) {
+            update_threshold(kvssd);
+            __atomic_fetch_sub(&kvssd->curr_iteration, kvssd->max_iterations, __ATOMIC_RELAXED);
+            return true;
+        }
+        return false;
+    }
+
+    add_kv_size(kvssd, klen + vlen);
     kvssd->curr_iteration++;
     if(kvssd->curr_iteration >= kvssd->max_iterations){
         update_threshold(kvssd);
         kvssd->curr_iteration = 0;
+        return true;
     }
-    //printf("Initial key hash: %llu\n", key_hash);
+    return false;
+}
 
-    for (int i = 0; i < kvssd->max_retry; i++) {
+// Tries retries first..max_retry-1 of the quadratic probe sequence of key_hash. Fills in
+// path unless it is NULL
+static bool write_retries(KVSSD *kvssd, const char *key, uint64_t key_hash, int first, int val, int klen, int vlen, OpPath *path) {
+    for (int i = first; i < kvssd->max_retry; i++) {
         uint64_t key_hash_retry = key_hash + i * i;
-        int t_page_idx = get_translation_page(kvssd, key_hash_retry);
+        uint64_t t_page_idx = get_translation_page(kvssd, key_hash_retry);
         //printf("Retry %d: Key hash retry: %llu, Translation page index: %zu\n", i, key_hash_retry, t_page_idx); // Debugging the key hash retry and page index
 
-        TranslationPage *t_page = kvssd->gmd[t_page_idx];
-
-        if (t_page == NULL) {
-            //printf("Creating new translation page at index %zu\n", t_page_idx); // Indicates a new page is being created
-            t_page = create_translation_page(kvssd->page_size, kvssd->slab_size, kvssd->threshold); 
-            kvssd->gmd[t_page_idx] = t_page;
-        } 
-        else {
-            //printf("Using existing translation page at index %zu\n", t_page_idx); // Indicates using an existing page
-        }
-
+        lock_slot(kvssd, t_page_idx);
+        TranslationPage *t_page = begin_update(kvssd, t_page_idx);
+        cache_touch(kvssd, t_page, true);
+        int evictions = t_page->evictions;
+        bool fresh = kvssd->filter != NULL && key_hash_type(t_page, key_hash_retry) == EMPTY_ENTRY;
         bool ret = insert(t_page, key_hash_retry, klen, vlen, key, val);
+        if (ret && fresh)
+            filter_update(kvssd, key_hash, 1);
+        if (ret && path != NULL) {
+            path->depth = i;
+            path->type = key_hash_type(t_page, key_hash_retry);
+            path->eviction = t_page->evictions != evictions;
+        }
+        end_update(kvssd, t_page_idx, t_page);
+        unlock_slot(kvssd, t_page_idx);
 
         if (ret) {
             return true;  // Write successful
         }
         
-        kvssd->retries++;
+        count(&thread_counters(kvssd)->retries);
         printf("Insert failed, retrying\n");
     }
 
     printf("Couldn't insert KVP\n");
 
-    kvssd->rejections++;
+    count(&thread_counters(kvssd)->rejections);
     return false;  // All retries exhausted, write failed
 }
 
-bool read(KVSSD *kvssd, const char *key) {
+// Slabs in use in GMD slot idx, 0 if it has no page
+static int slot_used(KVSSD *kvssd, uint64_t idx) {
+    TranslationPage *t_page = gmd_page(kvssd, idx);
+    return t_page == NULL ? 0 : t_page->d_entry_slabs + t_page->i_entry_count;
+}
+
+// A page make_room reached, and the entry that would move into it from the page of parent
+typedef struct {
+    uint64_t idx;
+    uint64_t key_hash;
+    int parent;         // -1 for the two pages of the key being written
+    int depth;
+} CuckooStep;
+
+// Frees a slab in GMD slot pages[0] or pages[1], which are both full, by moving entries to
+// their other page. A breadth first search from the two pages finds the shortest chain of
+// moves that ends in a page with room, then the chain is moved from that end so every entry
+// lands in a page that was just given room. Returns which of the two pages has room now, -1
+// if no chain of at most CUCKOO_MAX_DEPTH moves turned up in CUCKOO_MAX_PAGES pages
+static int make_room(KVSSD *kvssd, const uint64_t pages[2], uint64_t key_hash) {
+    int tt_slab = kvssd->page_size / kvssd->slab_size;
+    CuckooStep steps[CUCKOO_MAX_PAGES];
+    steps[0] = (CuckooStep){pages[0], 0, -1, 0};
+    steps[1] = (CuckooStep){pages[1], 0, -1, 0};
+    int n = 2, found = -1;
+
+    for (int s = 0; s < n && found < 0 && steps[s].depth < CUCKOO_MAX_DEPTH; s++) {
+        HashMap *map = gmd_page(kvssd, steps[s].idx)->key_hashes;
+        // Start where the key being written points, so writes to the same full page don't
+        // all move the same entries
+        for (int b = 0; b < map->size; b++) {
+            HashMapEntry *e = &map->table[(b + key_hash) & map->mask];
+            if (e->type == EMPTY_ENTRY)
+                continue;
+            uint64_t to = get_translation_page(kvssd, e->key_hash);
+            if (to == steps[s].idx)
+                to = cuckoo_page(kvssd, e->key_hash);
+            bool seen = to == pages[0] || to == pages[1];
+            for (int p = s; p >= 0 && !seen; p = steps[p].parent)
+                seen = steps[p].idx == to;
+            if (seen)
+                continue;
+
+            steps[n] = (CuckooStep){to, e->key_hash, s, steps[s].depth + 1};
+            if (slot_used(kvssd, to) < tt_slab) {
+                found = n;
+                break;
+            }
+            if (++n == CUCKOO_MAX_PAGES)
+                return -1;
+        }
+    }
+    if (found < 0)
+        return -1;
+
+    int s = found;
+    for (; steps[s].parent >= 0; s = steps[s].parent) {
+        TranslationPage *from = gmd_page(kvssd, steps[steps[s].parent].idx);
+        if (!move_entry(from, slot_page(kvssd, steps[s].idx), steps[s].key_hash))
+            return -1; // the moves so far stand, each one kept its entry reachable
+        count(&thread_counters(kvssd)->relocations);
+    }
+    return s;
+}
+
+// write_retries under cuckoo placement: an update stays in the page that has the key, a new
+// key tries its first page unless it is full and then the other one, and make_room is the
+// last resort. path->depth is 0, 1 or 2 for those three
+static bool write_cuckoo(KVSSD *kvssd, const char *key, uint64_t key_hash, int val, int klen, int vlen, OpPath *path) {
+    uint64_t pages[2] = {get_translation_page(kvssd, key_hash), cuckoo_page(kvssd, key_hash)};
+    int first = -1;
+    for (int i = 0; i < 2 && first < 0; i++) {
+        TranslationPage *t_page = gmd_page(kvssd, pages[i]);
+        if (t_page != NULL && hashmap_find(t_page->key_hashes, key_hash) != NULL)
+            first = i;
+    }
+    bool update = first >= 0;
+    if (!update)
+        first = slot_used(kvssd, pages[0]) >= kvssd->page_size / kvssd->slab_size;
+
+    for (int depth = 0; depth < 3; depth++) {
+        int i = depth < 2 ? first ^ depth : make_room(kvssd, pages, key_hash);
+        if (i < 0)
+            break;
+        TranslationPage *t_page = slot_page(kvssd, pages[i]);
+        int evictions = t_page->evictions;
+        if (insert(t_page, key_hash, klen, vlen, key, val)) {
+            if (!update)
+                filter_update(kvssd, key_hash, 1);
+            if (path != NULL) {
+                path->depth = depth;
+                path->type = key_hash_type(t_page, key_hash);
+                path->eviction = t_page->evictions != evictions;
+            }
+            return true;
+        }
+
+        count(&thread_counters(kvssd)->retries);
+        if (update)
+            break; // another key with the same hash, the other page can't tell them apart either
+    }
+
+    // Unlike write_retries this doesn't print, retries and rejections are in kvssd_stats
+    count(&thread_counters(kvssd)->rejections);
+    return false;
+}
+
+// write() after the key is hashed and logged, replay_wal applies records with it
+static bool write_hashed(KVSSD *kvssd, const char *key, uint64_t key_hash, int val, int klen, int vlen, OpPath *path) {
+    // Logic for updating the threshold based on the average kvp size
+    bool threshold = record_kvp_size(kvssd, klen, vlen);
+    //printf("Initial key hash: %llu\n", key_hash);
+    if (path != NULL)
+        path->threshold = threshold;
+
+    if (kvssd->cuckoo)
+        return write_cuckoo(kvssd, key, key_hash, val, klen, vlen, path);
+    return write_retries(kvssd, key, key_hash, 0, val, klen, vlen, path);
+}
+
+bool write(KVSSD *kvssd, const char *key, int val, int klen, int vlen) {
+    LatencyHistograms *lat = thread_latency(kvssd);
+    uint64_t t0 = lat != NULL ? clock_ns() : 0;
+    OpPath path = {-1, EMPTY_ENTRY, false, false};
+
     uint64_t key_hash = hash_k(key);
+    wal_wait(kvssd, wal_append(kvssd, WAL_WRITE, key, key_hash, val, klen, vlen));
+    bool ret = write_hashed(kvssd, key, key_hash, val, klen, vlen, lat != NULL ? &path : NULL);
+    if (lat != NULL)
+        time_op(lat, LAT_WRITE, t0, &path);
+    return ret;
+}
 
-    for (int i = 0; i < kvssd->max_retry; i++){
-        uint64_t key_hash_retry = key_hash + i * i;
-        int t_page_idx = get_translation_page(kvssd, key_hash_retry);
-        TranslationPage *t_page = kvssd->gmd[t_page_idx];
+// Stable LSD radix sort of order[0..n) by page[], uses tmp as scratch
+static void sort_by_page(const uint64_t *page, int *order, int *tmp, int n, uint64_t gmd_len) {
+    // Clearing the counts costs more than an insertion sort for small batches
+    if (n <= 64) {
+        for (int i = 1; i < n; i++) {
+            int o = order[i], k = i - 1;
+            for (; k >= 0 && page[order[k]] > page[o]; k--)
+                order[k + 1] = order[k];
+            order[k + 1] = o;
+        }
+        return;
+    }
 
-        if(t_page == NULL)
-            continue;
+    int radix = 1 << BATCH_RADIX_BITS;
+    int *count = malloc((radix + 1) * sizeof(int));
+    if (count == NULL) {
+        fprintf(stderr, "Failed to allocate memory for write_batch\n");
+        exit(1);
+    }
 
-        bool ret = find_value_by_key_hash(t_page, key_hash_retry, key);
-        if (ret)
-            return ret;
-        
-        kvssd->read_retries++;
+    for (int shift = 0; shift == 0 || (gmd_len - 1) >> shift != 0; shift += BATCH_RADIX_BITS) {
+        memset(count, 0, (radix + 1) * sizeof(int));
+        for (int i = 0; i < n; i++)
+            count[((page[order[i]] >> shift) & (radix - 1)) + 1]++;
+        for (int d = 0; d < radix; d++)
+            count[d + 1] += count[d];
+        for (int i = 0; i < n; i++)
+            tmp[count[(page[order[i]] >> shift) & (radix - 1)]++] = order[i];
+        memcpy(order, tmp, n * sizeof(int));
     }
+    free(count);
+}
+
+// Applies ops[start..end) (by index) in page order. Walks the sorted order twice: the first
+// walk finds the first op that might not succeed on its first page, meaning a hash collision
+// or a page that may be full. Every op before it is applied page by page, which is the same
+// as applying them in order since each one only touches its own page. That op then runs the
+// normal retry chain and the rest of the range goes around again
+static void write_batch_range(KVSSD *kvssd, const kv_op *ops, const uint64_t *hashes, const uint64_t *page,
+                              const int *order, int n, int start, int end, bool *results) {
+    int tt_slab = kvssd->page_size / kvssd->slab_size;
+    int threshold = kvssd->threshold; // what every page is synced to before its insert
+    int seq_run = 0;
+
+    while (start < end) {
+        // Pages are too full for the check to clear many writes, so each round would only
+        // apply a few. Write one at a time for a while, twice as long every time this repeats
+        for (int k = 0; k < seq_run && start < end; k++, start++)
+            results[start] = write_retries(kvssd, ops[start].key, hashes[start], 0, ops[start].val, ops[start].klen, ops[start].vlen, NULL);
+        if (start >= end)
+            break;
+
+        int stop = end;
+
+        for (int g = 0; g < n; ) {
+            if (g + 16 < n)
+                prefetch_slot(kvssd, page[order[g + 16]]);
+            if (g + 8 < n && gmd_page(kvssd, page[order[g + 8]]) != NULL)
+                __builtin_prefetch(gmd_page(kvssd, page[order[g + 8]]));
+            uint64_t p = page[order[g]];
+            TranslationPage *tp = gmd_page(kvssd, p);
+            int used = tp == NULL ? 0 : tp->d_entry_slabs + tp->i_entry_count;
+            int first = g;
+
+            for (; g < n && page[order[g]] == p; g++) {
+                int j = order[g];
+                if (j < start || j >= end)
+                    continue;
+                const kv_op *op = &ops[j];
+                bool safe = true;
+
+                // Another key with the same hash earlier in the range
+                bool repeat = false;
+                for (int k = g - 1; k >= first; k--) {
+                    int o = order[k];
+                    if (o >= start && o < end && hashes[o] == hashes[j]) {
+                        safe = strcmp(ops[o].key, op->key) == 0;
+                        repeat = true;
+                        break;
+                    }
+                }
+
+                // How much the op can grow the page: updates never fail unless the key
+                // collides, new keys need a free slab
+                int size = op->klen + op->vlen;
+                int slabs_needed = ceil((double)size / kvssd->slab_size);
+                HashMapEntry *entry = tp == NULL ? NULL : hashmap_find(tp->key_hashes, hashes[j]);
+                if (entry != NULL && entry->type == D_ENTRY) {
+                    int old_slabs = tp->d_entries[entry->slot].num_slabs;
+                    safe = safe && strcmp(dentry_key(tp, &tp->d_entries[entry->slot]), op->key) == 0;
+                    if (repeat && slabs_needed > 1)
+                        used += slabs_needed - 1;
+                    else if (!repeat && size <= threshold && slabs_needed > old_slabs)
+                        used += slabs_needed - old_slabs;
+                } else if (entry != NULL) {
+                    if ((repeat || size < threshold) && slabs_needed > 1)
+                        used += slabs_needed - 1;
+                } else {
+                    safe = safe && used < tt_slab;
+                    used += size > threshold || slabs_needed < 1 ? 1 : slabs_needed;
+                }
+
+                if (!safe && j < stop)
+                    stop = j;
+            }
+        }
+
+        for (int g = 0; g < n; g++) {
+            if (g + 8 < n && gmd_page(kvssd, page[order[g + 8]]) != NULL)
+                __builtin_prefetch(gmd_page(kvssd, page[order[g + 8]]));
+            int j = order[g];
+            if (j < start || j >= stop)
+                continue;
+            TranslationPage *t_page = slot_page(kvssd, page[j]);
+            bool fresh = kvssd->filter != NULL && key_hash_type(t_page, hashes[j]) == EMPTY_ENTRY;
+            results[j] = insert(t_page, hashes[j], ops[j].klen, ops[j].vlen, ops[j].key, ops[j].val);
+            if (results[j] && fresh)
+                filter_update(kvssd, hashes[j], 1);
+            if (!results[j]) { // not expected after the check, carry on like write() would
+                count(&thread_counters(kvssd)->retries);
+                printf("Insert failed, retrying\n");
+                results[j] = write_retries(kvssd, ops[j].key, hashes[j], 1, ops[j].val, ops[j].klen, ops[j].vlen, NULL);
+            }
+        }
+
+        if (stop < end)
+            results[stop] = write_retries(kvssd, ops[stop].key, hashes[stop], 0, ops[stop].val, ops[stop].klen, ops[stop].vlen, NULL);
+        if (stop < end && stop - start < BATCH_MIN_RUN)
+            seq_run = seq_run == 0 ? BATCH_MIN_RUN : seq_run * 2;
+        else
+            seq_run = 0;
+        start = stop + 1;
+    }
+}
+
+// Writes n KVPs with the same result as calling write() on each of them in order, but
+// hashes them together and applies them grouped by translation page so each page is
+// brought into cache once per batch instead of once per write
+void write_batch(KVSSD *kvssd, const kv_op *ops, int n, bool *results) {
+    if (n <= 0)
+        return;
+
+    // Grouping relies on nobody else touching the pages in between, on them staying in DRAM
+    // and on every key going to its first page when there is room
+    if (kvssd->shards || kvssd->cache != NULL || kvssd->cuckoo) {
+        for (int i = 0; i < n; i++)
+            results[i] = write(kvssd, ops[i].key, ops[i].val, ops[i].klen, ops[i].vlen);
+        return;
+    }
+
+    uint64_t *hashes = malloc(n * sizeof(uint64_t));
+    const char **keys = malloc(n * sizeof(char *));
+    int *lens = malloc(n * sizeof(int));
+    uint64_t *page = malloc(n * sizeof(uint64_t));
+    int *order = malloc(n * sizeof(int));
+    int *tmp = malloc(n * sizeof(int));
+    if (hashes == NULL || keys == NULL || lens == NULL || page == NULL || order == NULL || tmp == NULL) {
+        fprintf(stderr, "Failed to allocate memory for write_batch\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < n; i++) {
+        keys[i] = ops[i].key;
+        lens[i] = strlen(ops[i].key);
+    }
+    hash_k_batch(keys, lens, n, hashes);
+    uint64_t lsn = 0;
+    for (int i = 0; i < n; i++)
+        lsn = wal_append(kvssd, WAL_WRITE, ops[i].key, hashes[i], ops[i].val, ops[i].klen, ops[i].vlen);
+    wal_wait(kvssd, lsn);
+    for (int i = 0; i < n; i++) {
+        page[i] = get_translation_page(kvssd, hashes[i]);
+        order[i] = i;
+    }
+    sort_by_page(page, order, tmp, n, kvssd->gmd_len);
+
+    // A threshold update lands between two writes, so split the batch at the write whose size
+    // completes a round of max_iterations
+    int start = 0;
+    while (start < n) {
+        int room = kvssd->max_iterations - kvssd->curr_iteration; // writes up to the next update
+        if (room < 1)
+            room = 1;
+        int end = n - start < room ? n : start + room - 1;
+        for (int i = start; i < end; i++)
+            record_kvp_size(kvssd, ops[i].klen, ops[i].vlen);
+        write_batch_range(kvssd, ops, hashes, page, order, n, start, end, results);
+        if (end < n) {
+            record_kvp_size(kvssd, ops[end].klen, ops[end].vlen); // runs update_threshold
+            results[end] = write_retries(kvssd, ops[end].key, hashes[end], 0,
+                                         ops[end].val, ops[end].klen, ops[end].vlen, NULL);
+            end++;
+        }
+        start = end;
+    }
+
+    free(hashes);
+    free(keys);
+    free(lens);
+    free(page);
+    free(order);
+    free(tmp);
+}
 
-    kvssd->read_error++;
+// Looks key_hash up in GMD slot idx: the type of its entry (D_ENTRY or I_ENTRY) if found,
+// EMPTY_ENTRY if not, -1 if the slot has no page.
+// Copy-on-write readers must be inside an epoch and count their hits themselves, since
+// the page they see may already be a writer's old copy. Cached reads count theirs the same
+// way, so they leave the page clean
+static int probe_slot(KVSSD *kvssd, uint64_t idx, uint64_t key_hash) {
+    if (kvssd->copy_on_write || kvssd->cache != NULL) {
+        TranslationPage *t_page = gmd_page(kvssd, idx);
+        if (t_page == NULL)
+            return -1;
+        cache_touch(kvssd, t_page, false);
+        uint8_t type = key_hash_type(t_page, key_hash);
+        if (type == EMPTY_ENTRY)
+            return EMPTY_ENTRY;
+        KVSSDCounters *c = thread_counters(kvssd);
+        count(type == D_ENTRY ? &c->read_d_entry : &c->read_i_entry);
+        return type;
+    }
+
+    lock_slot(kvssd, idx);
+    TranslationPage *t_page = gmd_page(kvssd, idx);
+    int ret = t_page == NULL ? -1 : find_value_by_key_hash(t_page, key_hash);
+    unlock_slot(kvssd, idx);
+    return ret;
+}
+
+// Probes first..probe_count-1 of the probe sequence of key_hash (see probe_page). Fills in
+// path unless it is NULL
+static bool read_retries(KVSSD *kvssd, uint64_t key_hash, int first, OpPath *path) {
+    for (int i = first; i < probe_count(kvssd); i++){
+        uint64_t key_hash_retry;
+        uint64_t idx = probe_page(kvssd, key_hash, i, &key_hash_retry);
+        int ret = probe_slot(kvssd, idx, key_hash_retry);
+        if (ret > 0) {
+            if (path != NULL) {
+                path->depth = i;
+                path->type = ret;
+            }
+            return true;
+        }
+        if (ret == 0)
+            count(&thread_counters(kvssd)->read_retries);
+    }
+
+    count(&thread_counters(kvssd)->read_error);
     return false;
 }
 
-bool delete(KVSSD *kvssd, const char *key) {
-    uint64_t key_hash = hash_k(key); 
+bool read(KVSSD *kvssd, const char *key) {
+    LatencyHistograms *lat = thread_latency(kvssd);
+    uint64_t t0 = lat != NULL ? clock_ns() : 0;
+    OpPath path = {-1, EMPTY_ENTRY, false, false};
 
-    for (int i = 0; i < kvssd->max_retry; i++) {
-        uint64_t key_hash_retry = key_hash + i * i;  
-        int t_page_idx = get_translation_page(kvssd, key_hash_retry);  
-        TranslationPage *t_page = kvssd->gmd[t_page_idx];  
+    uint64_t key_hash = hash_k(key);
+    KVSSDThread *self = kvssd->copy_on_write ? enter_epoch(kvssd) : NULL;
+    bool ret = filter_may_contain(kvssd, key_hash) ? read_retries(kvssd, key_hash, 0, lat != NULL ? &path : NULL)
+                                                   : filter_miss(kvssd);
+    if (self != NULL)
+        exit_epoch(self);
+    if (lat != NULL)
+        time_op(lat, LAT_READ, t0, &path);
+    return ret;
+}
 
-        if (t_page == NULL) 
-            return false; // original (return false)
+// Same results and counters as calling read() on every key. Keys go through in groups of
+// READ_BATCH_GROUP: one pass prefetches their GMD slots, the next their page headers, the
+// next their key_hashes buckets, and the last does the lookups. Every load of a pass is
+// independent, so a group waits for about one cache miss per pass instead of three per key.
+// With a key filter, hashing is followed by a pass over the filter blocks, and keys the filter
+// turns away skip the rest. Keys that miss their first page continue with read()'s retries
+void read_batch(KVSSD *kvssd, const char *const *keys, int n, bool *results) {
+    uint64_t hashes[READ_BATCH_GROUP];
+    int lens[READ_BATCH_GROUP];
+    uint64_t idx[READ_BATCH_GROUP];
+    bool may[READ_BATCH_GROUP];
 
-        if(hashmap_get(t_page->key_hashes, key_hash) != NOT_FOUND){
-            bool ret;
-            int slab_index = hashmap_get(t_page->key_hashes, key_hash_retry);  // Get the index of the entry in the hash map
+    for (int base = 0; base < n; base += READ_BATCH_GROUP) {
+        int g = n - base < READ_BATCH_GROUP ? n - base : READ_BATCH_GROUP;
+        const char *const *k = keys + base;
+        if (g == 1 || kvssd->cache != NULL) { // nothing to overlap its misses with, or the pages of a group may not all fit
+            for (int i = 0; i < g; i++)
+                results[base + i] = read(kvssd, k[i]);
+            continue;
+        }
+
+        for (int i = 0; i < g; i++)
+            lens[i] = strlen(k[i]);
+        hash_k_batch(k, lens, g, hashes);
+        if (kvssd->filter != NULL)
+            for (int i = 0; i < g; i++)
+                prefetch_filter(kvssd, hashes[i]);
+        for (int i = 0; i < g; i++) {
+            idx[i] = get_translation_page(kvssd, hashes[i]);
+            may[i] = filter_may_contain(kvssd, hashes[i]);
+            if (may[i])
+                prefetch_slot(kvssd, idx[i]);
+        }
+        // Only the headers read here are never written after a page is published, so the
+        // prefetch passes don't take the shard locks. Copy-on-write readers hold their epoch
+        // for the whole group so the pages stay allocated
+        KVSSDThread *self = kvssd->copy_on_write ? enter_epoch(kvssd) : NULL;
+        TranslationPage *pages[READ_BATCH_GROUP];
+        for (int i = 0; i < g; i++) {
+            pages[i] = may[i] ? gmd_page(kvssd, idx[i]) : NULL;
+            if (pages[i] != NULL)
+                prefetch_page_index(pages[i]);
+        }
+        for (int i = 0; i < g; i++)
+            if (pages[i] != NULL)
+                prefetch_key_hash(pages[i], hashes[i]);
+
+        for (int i = 0; i < g; i++) {
+            if (!may[i]) {
+                results[base + i] = filter_miss(kvssd);
+                continue;
+            }
+            int found = probe_slot(kvssd, idx[i], hashes[i]);
+            if (found > 0) {
+                results[base + i] = true;
+                continue;
+            }
+            if (found == 0)
+                count(&thread_counters(kvssd)->read_retries);
+            results[base + i] = read_retries(kvssd, hashes[i], 1, NULL);
+        }
+        if (self != NULL)
+            exit_epoch(self);
+    }
+}
 
-            if (slab_index != -1){ 
+// delete() after the key is hashed and logged. Fills in path unless it is NULL
+static bool delete_hashed(KVSSD *kvssd, uint64_t key_hash, OpPath *path) {
+    if (!filter_may_contain(kvssd, key_hash))
+        return false;
+    for (int i = 0; i < probe_count(kvssd); i++) {
+        uint64_t key_hash_retry;
+        uint64_t t_page_idx = probe_page(kvssd, key_hash, i, &key_hash_retry);
+        lock_slot(kvssd, t_page_idx);
+        TranslationPage *t_page = gmd_page(kvssd, t_page_idx);  
+
+        if (t_page == NULL){
+            unlock_slot(kvssd, t_page_idx);
+            return false; // original (return false)
+        }
+
+        bool ret = false;
+        HashMapEntry *entry = hashmap_find(t_page->key_hashes, key_hash_retry);
+        cache_touch(kvssd, t_page, entry != NULL);
+        uint8_t type = entry == NULL ? EMPTY_ENTRY : entry->type;
+        if(entry != NULL){
+            bool d_entry = type == D_ENTRY;
+            t_page = begin_update(kvssd, t_page_idx);
+            if (d_entry){ 
                 ret = delete_dentry(t_page, key_hash_retry); // Delete D-entry
             }
             else {
                 ret = delete_ientry(t_page, key_hash_retry); // Delete I-entry
             }
-            if (ret){
-                return true;
-            };
+            end_update(kvssd, t_page_idx, t_page);
         }
+        if (ret)
+            filter_update(kvssd, key_hash, -1);
+        unlock_slot(kvssd, t_page_idx);
+        if (ret){
+            if (path != NULL) {
+                path->depth = i;
+                path->type = type;
+            }
+            return true;
+        };
     }
 
     return false; 
 }
 
+bool delete(KVSSD *kvssd, const char *key) {
+    LatencyHistograms *lat = thread_latency(kvssd);
+    uint64_t t0 = lat != NULL ? clock_ns() : 0;
+    OpPath path = {-1, EMPTY_ENTRY, false, false};
+
+    uint64_t key_hash = hash_k(key); 
+    wal_wait(kvssd, wal_append(kvssd, WAL_DELETE, key, key_hash, 0, 0, 0));
+    bool ret = delete_hashed(kvssd, key_hash, lat != NULL ? &path : NULL);
+    if (lat != NULL)
+        time_op(lat, LAT_DELETE, t0, &path);
+    return ret;
+}
+
+// Mean size of the KVPs written so far this round
 double get_avg_kv(KVSSD *kvssd){
-    unsigned int sum = 0;
-    for (int i = 0; i < kvssd->max_iterations; i++){
-        sum += kvssd->kvp_sizes[i];
-    }
+    SizeSketch *sk = &kvssd->kv_sizes;
+    uint64_t n = __atomic_load_n(&sk->n, __ATOMIC_RELAXED); // other threads may be recording sizes
+    uint64_t sum = __atomic_load_n(&sk->sum, __ATOMIC_RELAXED);
+    return n == 0 ? 0 : (double)(sum / n);
+}
 
-    return sum / kvssd->max_iterations;
+// Size below which percentile % (0-100) of the KVPs written so far this round fall
+int get_kv_percentile(KVSSD *kvssd, double percentile) {
+    SizeSketch copy;
+    for (int b = 0; b < SIZE_BUCKETS; b++)
+        copy.counts[b] = __atomic_load_n(&kvssd->kv_sizes.counts[b], __ATOMIC_RELAXED);
+    return sketch_percentile(&copy, percentile);
 }
 
 void update_threshold(KVSSD *kvssd){
+    if (kvssd->shards)
+        pthread_mutex_lock(&kvssd->threshold_lock); // one update at a time in sharded mode
+
     //printf("Updating threshold\nOld Threshold: %d\n", kvssd->threshold);
-    double avg = get_avg_kv(kvssd);
+    SizeSketch round;
+    take_kv_sizes(kvssd, &round);
+    double avg = kvssd->threshold_percentile > 0 ? sketch_percentile(&round, kvssd->threshold_percentile)
+                                                 : sketch_mean(&round);
     //printf("Found new threshold: %f\n", avg);
     int new_threshold = ceil(avg / 20) * 20;
 
-    // Do nothing if the new threshold is the same as the old one
-    if (new_threshold == kvssd->threshold)
-        return;
-    
-    // If the new threshold is larger than the page size make it equal to the page size
-    if (new_threshold > kvssd->page_size){
-        new_threshold = kvssd->page_size;
+    // Do nothing if the new threshold is the same as the old one, or no KVP was written
+    if (round.n != 0 && new_threshold != kvssd->threshold){
+        // If the new threshold is larger than the page size make it equal to the page size
+        if (new_threshold > kvssd->page_size){
+            new_threshold = kvssd->page_size;
+        }
+
+        // Translation pages take it over when they are next written, see sync_threshold
+        __atomic_store_n(&kvssd->threshold, new_threshold, __ATOMIC_RELAXED);
     }
 
-    // Update the threshold in each translation page
-    kvssd->threshold = new_threshold;
-    for (int i=0; i < kvssd->gmd_len; i++){
-        TranslationPage *t_page = kvssd->gmd[i];
-        if (t_page == NULL)
+    if (kvssd->shards)
+        pthread_mutex_unlock(&kvssd->threshold_lock);
+}
+
+static void add_page_stats(KVSSD *kvssd, KVSSDStats *st, TranslationPage *t_page) {
+    for (int j = next_dentry(t_page, 0); j != -1; j = next_dentry(t_page, j + 1)){
+        st->tt_space += t_page->d_entries[j].num_slabs * kvssd->slab_size;
+        st->d_space += t_page->d_entries[j].num_slabs * kvssd->slab_size;
+    }
+
+    st->i_space += t_page->i_entry_count * kvssd->slab_size;
+    st->tt_space += t_page->i_entry_count * kvssd->slab_size;
+
+    st->d_entries += t_page->dentry_count;
+    st->i_entries += t_page->i_entry_count;
+    st->keys += t_page->key_hashes->count;
+    //st->empty_slabs += (t_page->tt_slab - t_page->d_entry_slabs - t_page->i_entry_slabs);
+
+    st->evictions += t_page->evictions;
+    st->inserts += t_page->inserts;
+    st->updates += t_page->updates;
+    st->read_d_entry += t_page->read_d_entry;
+    st->read_i_entry += t_page->read_i_entry;
+    st->new_i_entry += t_page->new_i_entry;
+    st->new_d_entry += t_page->new_d_entry;
+    st->update_i_entry += t_page->update_i_entry;
+    st->update_d_entry += t_page->update_d_entry;
+    st->tt_pages++;
+}
+
+// Adds up the pages under top GMD entries [start, end) into the chunk's own KVSSDStats
+static void sum_page_stats(KVSSD *kvssd, int chunk, uint64_t start, uint64_t end, void *ctx) {
+    KVSSDStats *st = (KVSSDStats *)ctx + chunk;
+    for (uint64_t t = start; t < end; t++) {
+        GmdNode *node = kvssd->gmd[t];
+        if (node == NULL)
             continue;
+        for (int l = 0; l < 1 << GMD_NODE_BITS; l++) {
+            GmdLeaf *leaf = node->leaves[l];
+            if (leaf == NULL)
+                continue;
+            for (int s = 0; s < 1 << GMD_LEAF_BITS; s++) {
+                if (s + 8 < 1 << GMD_LEAF_BITS && leaf->slots[s + 8] != NULL) {
+                    __builtin_prefetch(leaf->slots[s + 8]);
+                    __builtin_prefetch((char *)leaf->slots[s + 8] + 64);
+                }
+                TranslationPage *t_page = leaf->slots[s];
+                uint64_t idx = (t << GMD_TOP_SHIFT) | ((uint64_t)l << GMD_LEAF_BITS) | s;
+                if (t_page == (TranslationPage *)GMD_PAGED_OUT) {
+                    // Read past the cache, a walk over every page would only thrash it
+                    cache_io(kvssd->cache, idx, kvssd->cache->scratch, false);
+                    t_page = rebase_translation_page(kvssd->cache->scratch);
+                } else if ((uintptr_t)t_page & GMD_SNAPSHOT_TAG) {
+                    t_page = gmd_fault(kvssd, idx);
+                }
+                if (t_page != NULL)
+                    add_page_stats(kvssd, st, t_page);
+            }
+        }
+    }
+}
 
-        t_page->threshold = new_threshold;
+// Totals over every translation page and thread. Like get_stats it needs the KVSSD to itself
+KVSSDStats kvssd_stats(KVSSD *kvssd) {
+    uint64_t size = chunk_size(kvssd->gmd_top_len);
+    int chunks = (kvssd->gmd_top_len + size - 1) / size;
+    KVSSDStats *parts = calloc(chunks, sizeof(KVSSDStats));
+    if (parts == NULL){
+        fprintf(stderr, "Failed to allocate memory for stats\n");
+        exit(1);
     }
+    parallel_chunks(kvssd, kvssd->gmd_top_len, sum_page_stats, parts);
+
+    KVSSDStats st;
+    memset(&st, 0, sizeof(KVSSDStats));
+    for (int c = 0; c < chunks; c++) {
+        KVSSDStats *p = &parts[c];
+        st.tt_pages += p->tt_pages;
+        st.d_entries += p->d_entries;
+        st.i_entries += p->i_entries;
+        st.empty_slabs += p->empty_slabs;
+        st.tt_space += p->tt_space;
+        st.d_space += p->d_space;
+        st.i_space += p->i_space;
+        st.keys += p->keys;
+        st.new_d_entry += p->new_d_entry;
+        st.new_i_entry += p->new_i_entry;
+        st.update_d_entry += p->update_d_entry;
+        st.update_i_entry += p->update_i_entry;
+        st.evictions += p->evictions;
+        st.inserts += p->inserts;
+        st.updates += p->updates;
+        st.read_d_entry += p->read_d_entry;
+        st.read_i_entry += p->read_i_entry;
+    }
+    free(parts);
+
+    KVSSDCounters counters = kvssd_counters(kvssd);
+    st.rejections = counters.rejections;
+    st.retries = counters.retries;
+    st.read_retries = counters.read_retries;
+    st.read_errors = counters.read_error;
+    st.read_d_entry += counters.read_d_entry;
+    st.read_i_entry += counters.read_i_entry;
+    st.relocations = counters.relocations;
+    st.filter_negatives = counters.filter_negatives;
+    return st;
 }
 
 // prints the specifics of our kvssd
 void get_stats(KVSSD *kvssd) {
     printf("Getting stats\n");
-    int tt_d_entry = 0, tt_i_entry_slab = 0, tt_i_entry = 0, tt_empty_slab = 0;
-    int tt_keys = 0;
-    int d_entry = 0, i_entry = 0;
-    int update_d_entry = 0, update_i_entry = 0;
-    int tt_retries = 0, tt_evictions = 0;
-    int tt_inserts = 0, tt_updates = 0, tt_rejections = 0;
-    int tt_read_d_entry = 0, tt_read_i_entry = 0, tt_read_retries = 0, tt_read_errors = 0;
-    int tt_pages = 0;
-    unsigned int tt_space = 0;
-    unsigned int td_space = 0;
-    unsigned int ti_space = 0;
-
-    for (size_t i = 0; i < kvssd->gmd_len; i++) {
-        TranslationPage *t_page = kvssd->gmd[i];
-        if (t_page == NULL) 
+    KVSSDStats st = kvssd_stats(kvssd);
+
+    printf("TT_INDEX_PAGES: %d. TT_SLABS: %ld\n", st.tt_pages, (long)st.tt_pages * (kvssd->page_size / kvssd->slab_size));
+    printf("D-entry: %d, I-entry: %d, Empty slab: %d\n", st.d_entries, st.i_entries, st.empty_slabs);
+    printf("TT_Space: %d, TT_D_Space: %d, TT_I_Space: %d\n", st.tt_space, st.d_space, st.i_space);
+    printf("TT_KEYS: %d, NEW-DENTRY: %d, NEW-IENTRY: %d\n", st.keys, st.new_d_entry, st.new_i_entry);
+    printf("UPDATE-DENTRY: %d, UPDATE-IENTRY: %d\n", st.update_d_entry, st.update_i_entry);
+    printf("Retries: %d, Evictions: %d, Rejections: %d\n", st.retries, st.evictions, st.rejections);
+    printf("Insert: %d, Update: %d\n", st.inserts, st.updates);
+    printf("Read_D-entry: %d, Read-I-entry: %d\n", st.read_d_entry, st.read_i_entry);
+    printf("Read_Retry: %d, Read_Error: %d\n", st.read_retries, st.read_errors);
+    if (kvssd->cuckoo)
+        printf("Relocations: %d\n", st.relocations);
+    if (kvssd->filter != NULL)
+        printf("Filter_Negatives: %d\n", st.filter_negatives);
+}
+
+// Start of a snapshot file. The GMD slot of every page follows as a uint64_t, then from
+// pages_offset on the page images (translation_page_image), page_bytes apart and in the same
+// order. Numbers are in the byte order of the machine that wrote it
+typedef struct {
+    char magic[8];             // "KVSSDSNP"
+    uint32_t version;          // SNAPSHOT_VERSION
+    uint32_t page_header;      // sizeof(TranslationPage) of the build that wrote it
+    uint64_t capacity;
+    int page_size;
+    int slab_size;
+    int threshold;
+    int max_retry;
+    int cuckoo;
+    int curr_iteration;
+    int max_iterations;
+    int i_entry_called;
+    double threshold_percentile;
+    KVSSDCounters counters;
+    SizeSketch kv_sizes;
+    uint64_t lsn;              // replay_wal applies the log records after this one
+    uint64_t page_bytes;
+    uint64_t page_count;
+    uint64_t pages_offset;     // multiple of 4096 so the images can be mapped in place
+} SnapshotHeader;
+
+// Writes every translation page, the threshold state and the counters to path, see
+// SnapshotHeader. Like get_stats it needs the KVSSD to itself. With a log, the snapshot
+// only covers records that are already on disk
+bool save_KVSSD(KVSSD *kvssd, const char *path) {
+    kvssd_sync_wal(kvssd);
+    uint64_t count = 0, cap = 1024;
+    uint64_t *slots = malloc(cap * sizeof(uint64_t));
+    char *image = malloc(kvssd->page_pool.page_bytes);
+    if (slots == NULL || image == NULL){
+        fprintf(stderr, "Failed to allocate memory for snapshot\n");
+        exit(1);
+    }
+    for (uint64_t t = 0; t < kvssd->gmd_top_len; t++) {
+        if (kvssd->gmd[t] == NULL)
             continue;
-        
-        for (int j = 0; j < t_page->dentry_idx; j++){
-            tt_space += t_page->d_entries[j].num_slabs * kvssd->slab_size;
-            td_space += t_page->d_entries[j].num_slabs * kvssd->slab_size;
-        }
-
-        ti_space += t_page->i_entry_count * kvssd->slab_size;
-        tt_space += t_page->i_entry_count * kvssd->slab_size;
-
-        tt_d_entry += t_page->dentry_idx;
-        tt_i_entry_slab += t_page->i_entry_count;
-        //tt_keys += t_page->key_hashes->count; // Assuming hashmap_size() calculates number of keys
-        //tt_empty_slab += (t_page->tt_slab - t_page->d_entry_slabs - t_page->i_entry_slabs);
-
-        tt_evictions += t_page->evictions;
-        tt_inserts += t_page->inserts;
-        tt_updates += t_page->updates;
-        tt_read_d_entry += t_page->read_d_entry;
-        tt_read_i_entry += t_page->read_i_entry;
-        i_entry += t_page->new_i_entry;
-        d_entry += t_page->new_d_entry;
-        update_i_entry += t_page->update_i_entry;
-        update_d_entry += t_page->update_d_entry;
-        tt_pages++;
-    }
-
-    tt_rejections = kvssd->rejections;
-    tt_retries = kvssd->retries;
-    tt_read_retries = kvssd->read_retries;
-    tt_read_errors = kvssd->read_error;
-
-    printf("TT_INDEX_PAGES: %d. TT_SLABS: %ld\n", tt_pages, tt_pages * (kvssd->page_size / kvssd->slab_size));
-    printf("D-entry: %d, I-entry: %d, Empty slab: %d\n", tt_d_entry, tt_i_entry_slab, tt_empty_slab);
-    printf("TT_Space: %d, TT_D_Space: %d, TT_I_Space: %d\n", tt_space, td_space, ti_space);
-    printf("TT_KEYS: %d, NEW-DENTRY: %d, NEW-IENTRY: %d\n", tt_keys, d_entry, i_entry);
-    printf("UPDATE-DENTRY: %d, UPDATE-IENTRY: %d\n", update_d_entry, update_i_entry);
-    printf("Retries: %d, Evictions: %d, Rejections: %d\n", tt_retries, tt_evictions, tt_rejections);
-    printf("Insert: %d, Update: %d\n", tt_inserts, tt_updates);
-    printf("Read_D-entry: %d, Read-I-entry: %d\n", tt_read_d_entry, tt_read_i_entry);
-    printf("Read_Retry: %d, Read_Error: %d\n", tt_read_retries, tt_read_errors);
+        for (int l = 0; l < 1 << GMD_NODE_BITS; l++) {
+            GmdLeaf *leaf = kvssd->gmd[t]->leaves[l];
+            if (leaf == NULL)
+                continue;
+            for (int s = 0; s < 1 << GMD_LEAF_BITS; s++) {
+                if (leaf->slots[s] == NULL)
+                    continue;
+                if (count == cap) {
+                    cap *= 2;
+                    slots = realloc(slots, cap * sizeof(uint64_t));
+                    if (slots == NULL){
+                        fprintf(stderr, "Failed to allocate memory for snapshot\n");
+                        exit(1);
+                    }
+                }
+                slots[count++] = (t << GMD_TOP_SHIFT) | ((uint64_t)l << GMD_LEAF_BITS) | s;
+            }
+        }
+    }
+
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(SnapshotHeader));
+    memcpy(h.magic, "KVSSDSNP", 8);
+    h.version = SNAPSHOT_VERSION;
+    h.page_header = sizeof(TranslationPage);
+    h.capacity = kvssd->capacity;
+    h.page_size = kvssd->page_size;
+    h.slab_size = kvssd->slab_size;
+    h.threshold = kvssd->threshold;
+    h.max_retry = kvssd->max_retry;
+    h.cuckoo = kvssd->cuckoo;
+    h.curr_iteration = kvssd->curr_iteration;
+    h.max_iterations = kvssd->max_iterations;
+    h.i_entry_called = kvssd->i_entry_called;
+    h.threshold_percentile = kvssd->threshold_percentile;
+    h.counters = kvssd_counters(kvssd);
+    h.kv_sizes = kvssd->kv_sizes;
+    h.lsn = kvssd->lsn;
+    h.page_bytes = kvssd->page_pool.page_bytes;
+    h.page_count = count;
+    h.pages_offset = (sizeof(SnapshotHeader) + count * sizeof(uint64_t) + 4095) / 4096 * 4096;
+
+    bool ok = false;
+    FILE *f = fopen(path, "wb");
+    if (f != NULL && fwrite(&h, sizeof(SnapshotHeader), 1, f) == 1
+        && fwrite(slots, sizeof(uint64_t), count, f) == count) {
+        memset(image, 0, kvssd->page_pool.page_bytes);
+        size_t pad = h.pages_offset - sizeof(SnapshotHeader) - count * sizeof(uint64_t);
+        ok = fwrite(image, 1, pad, f) == pad;
+        for (uint64_t i = 0; ok && i < count; i++) {
+            translation_page_image(gmd_page(kvssd, slots[i]), image);
+            ok = fwrite(image, kvssd->page_pool.page_bytes, 1, f) == 1;
+        }
+    }
+    if (f != NULL && fclose(f) != 0)
+        ok = false;
+    if (!ok)
+        fprintf(stderr, "Failed to write snapshot %s\n", path);
+
+    free(image);
+    free(slots);
+    return ok;
+}
+
+// Initializes ssd from a snapshot save_KVSSD wrote. The file is mapped rather than read, so
+// this only fills in the GMD slots and ssd can serve reads straight away. A page is faulted
+// in and rebased (gmd_fault) the first time it is used. The mapping is private, changes to
+// the pages never reach the file. ssd starts out single threaded
+bool load_KVSSD(KVSSD *ssd, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL){
+        fprintf(stderr, "Failed to open snapshot %s\n", path);
+        return false;
+    }
+
+    SnapshotHeader h;
+    struct stat st;
+    if (fread(&h, sizeof(SnapshotHeader), 1, f) != 1 || fstat(fileno(f), &st) != 0
+        || memcmp(h.magic, "KVSSDSNP", 8) != 0 || h.version != SNAPSHOT_VERSION
+        || h.page_header != sizeof(TranslationPage)
+        || h.page_bytes != translation_page_bytes(h.page_size, h.slab_size)
+        || h.page_count > (uint64_t)st.st_size / h.page_bytes
+        || h.pages_offset < sizeof(SnapshotHeader) + h.page_count * sizeof(uint64_t)
+        || h.pages_offset % 4096 != 0
+        || h.pages_offset + h.page_count * h.page_bytes > (uint64_t)st.st_size) {
+        fprintf(stderr, "%s is not a snapshot this build can load\n", path);
+        fclose(f);
+        return false;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(f), 0);
+    fclose(f);
+    if (map == MAP_FAILED){
+        fprintf(stderr, "Failed to map snapshot %s\n", path);
+        return false;
+    }
+
+    init_KVSSD(ssd, h.capacity, h.page_size, h.slab_size, h.threshold);
+    ssd->max_retry = h.max_retry;
+    ssd->cuckoo = h.cuckoo;
+    ssd->curr_iteration = h.curr_iteration;
+    ssd->max_iterations = h.max_iterations;
+    ssd->i_entry_called = h.i_entry_called;
+    ssd->threshold_percentile = h.threshold_percentile;
+    ssd->counters = h.counters;
+    ssd->kv_sizes = h.kv_sizes;
+    ssd->lsn = h.lsn;
+    ssd->snapshot = map;
+    ssd->snapshot_bytes = st.st_size;
+
+    const uint64_t *slots = (const uint64_t *)((char *)map + sizeof(SnapshotHeader));
+    char *pages = (char *)map + h.pages_offset;
+    for (uint64_t i = 0; i < h.page_count; i++) {
+        if (slots[i] >= ssd->gmd_len) {
+            fprintf(stderr, "%s is not a snapshot this build can load\n", path);
+            free_KVSSD(ssd);
+            return false;
+        }
+        *gmd_slot(ssd, slots[i]) = (TranslationPage *)((uintptr_t)(pages + i * h.page_bytes) | GMD_SNAPSHOT_TAG);
+    }
+    // The pool takes the pages over, clear_KVSSD and copy-on-write writers free them into it
+    ssd->page_pool.pages_in_use += h.page_count;
+    return true;
+}
+
+// Maps all of f read only for a front to back walk, *base is NULL for an empty file
+static bool map_log(FILE *f, const char **base, size_t *bytes) {
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0)
+        return false;
+    *base = NULL;
+    *bytes = st.st_size;
+    if (*bytes == 0)
+        return true;
+    void *map = mmap(NULL, *bytes, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    if (map == MAP_FAILED)
+        return false;
+    madvise(map, *bytes, MADV_SEQUENTIAL);
+    *base = map;
+    return true;
+}
+
+// Walks the records of a log mapped at base up to the first torn or corrupt one, applying
+// those after kvssd->lsn when apply is set. Returns the bytes of good records, *last and
+// *chain are the lsn and check of the last of them
+static size_t wal_scan(KVSSD *kvssd, const char *base, size_t bytes, bool apply, uint64_t *last, uint64_t *chain, long *applied) {
+    char *key = NULL;
+    size_t key_cap = 0, off = 0;
+    *last = 0;
+    *chain = 0;
+    *applied = 0;
+    while (off + sizeof(WalRecord) <= bytes) {
+        WalRecord rec;
+        memcpy(&rec, base + off, sizeof(WalRecord));
+        size_t size = (sizeof(WalRecord) + (size_t)rec.key_len + 7) & ~(size_t)7;
+        if (rec.lsn <= *last || size > WAL_BUFFER || size > bytes - off)
+            break;
+        const char *rec_key = base + off + sizeof(WalRecord);
+        uint64_t check = rec.check;
+        if (wal_check(&rec, rec_key, *chain) != check)
+            break;
+
+        if (apply && rec.lsn > kvssd->lsn) {
+            if (rec.key_len + 1 > key_cap) {
+                key_cap = rec.key_len + 1;
+                key = realloc(key, key_cap);
+                if (key == NULL){
+                    fprintf(stderr, "Failed to allocate memory for log replay\n");
+                    exit(1);
+                }
+            }
+            memcpy(key, rec_key, rec.key_len);
+            key[rec.key_len] = '\0';
+            if (rec.op == WAL_WRITE)
+                write_hashed(kvssd, key, rec.key_hash, rec.val, rec.klen, rec.vlen, NULL);
+            else
+                delete_hashed(kvssd, rec.key_hash, NULL);
+            kvssd->lsn = rec.lsn;
+            (*applied)++;
+        }
+        *last = rec.lsn;
+        *chain = check;
+        off += size;
+    }
+    free(key);
+    return off;
+}
+
+// Logs every write, write_batch and delete to path from now on, ahead of applying it. A
+// flusher thread commits them in groups of batch records, or fewer once the oldest has
+// waited interval_us. With wait set each call returns only after its record is on disk,
+// otherwise a crash loses at most about interval_us of writes. An existing log is added to,
+// once replay_wal has brought the KVSSD up to its end. Writes of one key from two threads
+// at the same time may be logged in the other order than they were applied
+bool kvssd_open_wal(KVSSD *kvssd, const char *path, int batch, int interval_us, bool wait) {
+    int fd = open(path, O_RDWR | O_CREAT | O_DSYNC, 0644);
+    FILE *f = fd < 0 ? NULL : fdopen(fd, "r+b");
+    if (f == NULL){
+        fprintf(stderr, "Failed to open write-ahead log %s\n", path);
+        return false;
+    }
+    setvbuf(f, NULL, _IONBF, 0); // a group goes out in one write
+
+    const char *base;
+    size_t bytes;
+    uint64_t last, chain;
+    long applied;
+    if (!map_log(f, &base, &bytes)){
+        fprintf(stderr, "Failed to map write-ahead log %s\n", path);
+        fclose(f);
+        return false;
+    }
+    size_t end = wal_scan(kvssd, base, bytes, false, &last, &chain, &applied);
+    if (base != NULL)
+        munmap((void *)base, bytes);
+    if (last > kvssd->lsn){
+        fprintf(stderr, "%s has records the KVSSD does not, replay_wal it first\n", path);
+        fclose(f);
+        return false;
+    }
+    // Anything after the last good record is overwritten
+    if (fseek(f, end, SEEK_SET) != 0){
+        fprintf(stderr, "Failed to open write-ahead log %s\n", path);
+        fclose(f);
+        return false;
+    }
+
+    struct Wal *wal = calloc(1, sizeof(struct Wal));
+    if (wal == NULL || (wal->buf = malloc(WAL_BUFFER)) == NULL || (wal->spare = malloc(WAL_BUFFER)) == NULL){
+        fprintf(stderr, "Failed to allocate memory for write-ahead log\n");
+        exit(1);
+    }
+    wal->file = f;
+    wal->next_lsn = kvssd->lsn + 1;
+    wal->chain = chain;
+    wal->durable_lsn = kvssd->lsn;
+    wal->batch = batch < 1 ? 1 : batch;
+    wal->interval_ns = interval_us < 0 ? 0 : interval_us * 1000ULL;
+    wal->wait = wait;
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC); // clock_ns deadlines
+    pthread_cond_init(&wal->work, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&wal->done, NULL);
+    if (pthread_create(&wal->flusher, NULL, wal_flusher, wal) != 0){
+        fprintf(stderr, "Failed to start the write-ahead log flusher\n");
+        exit(1);
+    }
+    kvssd->wal = wal;
+    return true;
+}
+
+// Returns once every record logged so far is on disk, false if the log could not be written
+bool kvssd_sync_wal(KVSSD *kvssd) {
+    struct Wal *wal = kvssd->wal;
+    if (wal == NULL)
+        return true;
+    pthread_mutex_lock(&wal->lock);
+    uint64_t lsn = wal->next_lsn - 1;
+    wal->hurry++;
+    pthread_cond_signal(&wal->work);
+    while (wal->durable_lsn < lsn && !wal->failed)
+        pthread_cond_wait(&wal->done, &wal->lock);
+    wal->hurry--;
+    bool ok = !wal->failed;
+    pthread_mutex_unlock(&wal->lock);
+    return ok;
+}
+
+// Writes out what is still buffered and stops logging
+void kvssd_close_wal(KVSSD *kvssd) {
+    struct Wal *wal = kvssd->wal;
+    if (wal == NULL)
+        return;
+    pthread_mutex_lock(&wal->lock);
+    wal->stop = true;
+    pthread_cond_signal(&wal->work);
+    pthread_mutex_unlock(&wal->lock);
+    pthread_join(wal->flusher, NULL);
+
+    fclose(wal->file);
+    pthread_mutex_destroy(&wal->lock);
+    pthread_cond_destroy(&wal->work);
+    pthread_cond_destroy(&wal->done);
+    free(wal->buf);
+    free(wal->spare);
+    free(wal);
+    kvssd->wal = NULL;
+}
+
+// Applies the records of the log at path after kvssd->lsn in order, up to its end or the
+// first torn record. load_KVSSD of the latest snapshot followed by this brings back every
+// write that reached the log. Call it before kvssd_open_wal. Returns the records applied,
+// -1 if the log can't be read
+long replay_wal(KVSSD *kvssd, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL){
+        fprintf(stderr, "Failed to open write-ahead log %s\n", path);
+        return -1;
+    }
+    const char *base;
+    size_t bytes;
+    bool ok = map_log(f, &base, &bytes);
+    fclose(f);
+    if (!ok){
+        fprintf(stderr, "Failed to map write-ahead log %s\n", path);
+        return -1;
+    }
+
+    uint64_t last, chain;
+    long applied;
+    wal_scan(kvssd, base, bytes, true, &last, &chain, &applied);
+    if (base != NULL)
+        munmap((void *)base, bytes);
+    return applied;
 }
 
+// Build with -DKVSSD_NO_MAIN to link KVSSD into the programs under Benchmark/
+#ifndef KVSSD_NO_MAIN
 int main() {
     KVSSD *ssd = malloc(sizeof(KVSSD));
     if (ssd == NULL) {
@@ -328,3 +2463,4 @@ int main() {
 
     return 0;
 }
+#endif // KVSSD_NO_MAIN
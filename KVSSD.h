@@ -1,5 +1,5 @@
 #include "TranslationPage.h" 
-#include "HashFunction/MurmurHash3New.h"
+#include "HashFunction/Murmurhash3New.h"
 #include <stdint.h>
 #include <string.h>
 #include <stddef.h>
@@ -7,39 +7,290 @@
 #include <stdio.h>
 #include <time.h>
 #include <stdint.h>
+#include <pthread.h>
+
+#define PAGES_PER_REGION 4096 // Translation pages reserved at a time by the page pool
+#define BATCH_RADIX_BITS 11 // GMD index bits sorted per write_batch radix pass
+#define BATCH_MIN_RUN 64 // Shorter runs of writes cleared for grouping make write_batch fall back to write() for a while
+#define READ_BATCH_GROUP 32 // Keys read_batch has in flight at once
+#define GMD_LEAF_BITS 6 // log2 of the GMD slots per leaf
+#define GMD_NODE_BITS 6 // log2 of the leaves per middle node, so a top entry covers 4096 slots
+#define GMD_TOP_SHIFT (GMD_LEAF_BITS + GMD_NODE_BITS)
+#define GMD_CHUNK 16 // top GMD entries per chunk of a parallel walk
+#define GMD_MAX_CHUNKS 1024 // larger GMDs get larger chunks
+#define SIZE_SUB_BUCKETS 64 // KVP size histogram buckets per power of two, sizes below 128 are exact
+#define SIZE_BUCKETS (27 * SIZE_SUB_BUCKETS) // covers every int
+#define RETIRE_BATCH 64 // Pages a writer replaces before it tries to free the old copies (copy-on-write mode)
+#define GMD_SNAPSHOT_TAG 1 // Low bit of a GMD slot whose page load_KVSSD mapped and nothing has touched yet
+#define GMD_PAGED_OUT 2 // GMD slot of a page that only lives in the backing file, see init_KVSSD_cached
+#define SNAPSHOT_VERSION 5
+#define WAL_BUFFER (1 << 20) // Bytes of log records a KVSSD buffers before writers wait for the flusher
+#define WAL_WRITE 1
+#define WAL_DELETE 2
+#define LATENCY_MAX_NS UINT32_MAX // latency histograms put anything slower in their last bucket
+#define CUCKOO_MAX_DEPTH 4 // Entries a cuckoo write may move to make room, see init_KVSSD_cuckoo
+#define CUCKOO_MAX_PAGES 256 // Pages it searches for room before the write is rejected
+#define FILTER_HASHES 4 // Counters a key has in its block of the key filter, see kvssd_set_filter
+
+// Retry and error counters. A single threaded KVSSD counts into its own block, in sharded
+// mode every thread gets a block of its own and kvssd_counters() adds them up
+typedef struct {
+    int rejections;
+    int retries;
+    int read_retries;
+    int read_error;
+    int read_d_entry; // copy-on-write readers count hits here instead of in the page
+    int read_i_entry;
+    int relocations;  // entries cuckoo placement moved to their other page
+    int filter_negatives; // read misses the key filter answered without probing a page
+} KVSSDCounters;
+
+// A translation page replaced by a copy-on-write writer, freed once no reader can hold it
+typedef struct {
+    TranslationPage *page;
+    uint64_t epoch; // global epoch when it was replaced
+} RetiredPage;
+
+// Paths a write, read or delete is timed under once kvssd_track_latency is on. Every op
+// counts in its op's total and in each split that applies to it. Retry depth is the probe
+// (0 for the first page) where the key was written or found, misses have none
+enum {
+    LAT_WRITE,
+    LAT_WRITE_D_ENTRY,      // the key ended up in a D-entry
+    LAT_WRITE_I_ENTRY,
+    LAT_WRITE_EVICTION,     // the page turned a D-entry into an I-entry on the way
+    LAT_WRITE_PLAIN,
+    LAT_WRITE_THRESHOLD,    // the write ran update_threshold first
+    LAT_WRITE_FIRST_TRY,
+    LAT_WRITE_RETRY_1,
+    LAT_WRITE_RETRY_2_PLUS,
+    LAT_WRITE_REJECTED,
+    LAT_READ,
+    LAT_READ_D_ENTRY,
+    LAT_READ_I_ENTRY,
+    LAT_READ_MISS,
+    LAT_READ_FIRST_TRY,
+    LAT_READ_RETRY_1,
+    LAT_READ_RETRY_2_PLUS,
+    LAT_DELETE,
+    LAT_DELETE_D_ENTRY,
+    LAT_DELETE_I_ENTRY,
+    LAT_DELETE_MISS,
+    LAT_DELETE_FIRST_TRY,
+    LAT_DELETE_RETRY_1,
+    LAT_DELETE_RETRY_2_PLUS,
+    LATENCY_PATHS
+};
+
+// Latencies of every path in ns, on the log-linear buckets of SizeSketch (exact below 128 ns,
+// within 1.6% above). sum and max are exact
+typedef struct {
+    uint64_t counts[LATENCY_PATHS][SIZE_BUCKETS];
+    uint64_t n[LATENCY_PATHS];
+    uint64_t sum[LATENCY_PATHS];
+    uint64_t max[LATENCY_PATHS];
+} LatencyHistograms;
+
+// One path of kvssd_latency, in ns
+typedef struct {
+    uint64_t count;
+    double mean;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+} LatencySummary;
+
+// Per-thread state of a sharded KVSSD
+typedef struct KVSSDThread {
+    KVSSDCounters counters;
+    LatencyHistograms *latency; // sharded mode, allocated on the thread's first timed op
+    uint64_t epoch;            // global epoch the thread is reading in, 0 when not reading
+    RetiredPage *retired;      // pages this thread replaced that may still be read
+    int retired_count;
+    int retired_cap;
+    pthread_t owner;
+    struct KVSSDThread *next;
+} KVSSDThread;
+
+// Translation page traffic of a KVSSD with a DRAM budget, see init_KVSSD_cached
+typedef struct {
+    uint64_t accesses;     // pages write, read and delete looked at
+    uint64_t misses;       // accesses that had to read the page from flash first
+    uint64_t flash_writes; // dirty pages written back when their frame was reused
+    int frames;            // the budget, in translation pages
+    int resident;
+} KVSSDCacheStats;
+
+// Totals get_stats prints, see kvssd_stats
+typedef struct {
+    int tt_pages;
+    int d_entries;
+    int i_entries;
+    int empty_slabs;
+    unsigned int tt_space;
+    unsigned int d_space;
+    unsigned int i_space;
+    int keys;
+    int new_d_entry;
+    int new_i_entry;
+    int update_d_entry;
+    int update_i_entry;
+    int retries;
+    int evictions;
+    int rejections;
+    int inserts;
+    int updates;
+    int read_d_entry;
+    int read_i_entry;
+    int read_retries;
+    int read_errors;
+    int relocations;
+    int filter_negatives;
+} KVSSDStats;
+
+// Histogram of the KVP sizes written in the current round of max_iterations writes. Buckets
+// are log-linear (within 1.6% of the size above 128 bytes), the sum is exact
+typedef struct {
+    uint32_t counts[SIZE_BUCKETS];
+    uint64_t n;
+    uint64_t sum;
+} SizeSketch;
+
+// The GMD is a radix tree: a top array allocated up front, whose entries point to middle
+// nodes, whose entries point to leaves of GMD slots. Nodes and leaves are only allocated
+// when a page is first created under them, and stay until free_KVSSD
+typedef struct {
+    TranslationPage *slots[1 << GMD_LEAF_BITS];
+} GmdLeaf;
+
+typedef struct {
+    GmdLeaf *leaves[1 << GMD_NODE_BITS];
+} GmdNode;
+
+struct GmdWorkers; // thread pool of the parallel walks, KVSSD.c
 
 typedef struct {\
     int curr_iteration;
     int max_iterations;
-    int *kvp_sizes; 
+    SizeSketch kv_sizes;
+    double threshold_percentile; // 0 sets the threshold from the mean KVP size, else from this percentile
     int threshold;
     uint64_t capacity;
     int page_size;
     int pages_per_block;
     int block_size;
-    int tt_blocks;
-    int tt_pages;
+    uint64_t tt_blocks;
+    uint64_t tt_pages;
     int address_size;
     int slab_size;
     float l2p_ratio;
-    int gmd_len;
-    TranslationPage **gmd;  
+    uint64_t gmd_len;
+    GmdNode **gmd;          // read slots with gmd_page
+    uint64_t gmd_top_len;   // entries of the top array
+    PagePool page_pool; // Every page in gmd is carved from here
     int max_retry;
-    int rejections;
-    int retries;
-    int read_retries;
-    int read_error;
+    bool cuckoo;            // two pages per key instead of max_retry probes, see init_KVSSD_cuckoo
+    KVSSDCounters counters; // single threaded mode, sharded mode counts in threads
     int i_entry_called;
+
+    // Sharded mode, see init_KVSSD_sharded. shards == 0 means no locking at all
+    int shards;
+    uint64_t shard_span;            // GMD slots per shard, shard i locks [i * shard_span, (i + 1) * shard_span)
+    pthread_mutex_t *shard_locks;
+    pthread_mutex_t pool_lock;      // page_pool
+    pthread_mutex_t threshold_lock; // one update_threshold at a time
+    pthread_mutex_t counters_lock;  // adding to threads
+    KVSSDThread *threads;           // per-thread state, newest first
+    uint64_t instance;              // tells a thread's cached state apart from one of a freed KVSSD
+
+    // kvssd_stats splits its GMD walk over this many threads besides the caller, see
+    // set_gmd_workers. The threads start on the first walk
+    int gmd_workers;
+    struct GmdWorkers *workers;
+    pthread_mutex_t walk_lock;      // one walk at a time
+
+    // Copy-on-write mode, see init_KVSSD_cow
+    bool copy_on_write;
+    uint64_t epoch;                 // global reclamation epoch
+
+    // Snapshot file mapped by load_KVSSD. Its pages join page_pool as they are touched
+    void *snapshot;
+    size_t snapshot_bytes;
+    pthread_mutex_t snapshot_lock;  // one snapshot page rebased at a time
+
+    // Write-ahead log, see kvssd_open_wal. NULL when writes are not logged
+    struct Wal *wal;
+    uint64_t lsn;                   // last log record the KVSSD holds, snapshots save it
+
+    // DRAM budget, see init_KVSSD_cached. NULL keeps every page in DRAM
+    struct PageCache *cache;
+
+    // Per path latencies, see kvssd_track_latency. Sharded mode times into the threads
+    bool track_latency;
+    LatencyHistograms *latency;
+
+    // Membership filter over the keys, see kvssd_set_filter. NULL when there is none
+    struct KeyFilter *filter;
 } KVSSD;
 
+// One write for write_batch, same arguments as write()
+typedef struct {
+    const char *key;
+    int val;
+    int klen;
+    int vlen;
+} kv_op;
+
+TranslationPage *gmd_fault(KVSSD *kvssd, uint64_t idx);
+
+// Page in GMD slot idx, NULL if there is none. Safe without locks, slots, nodes and leaves
+// are published with release stores
+static inline TranslationPage *gmd_page(KVSSD *kvssd, uint64_t idx) {
+    GmdNode *node = __atomic_load_n(&kvssd->gmd[idx >> GMD_TOP_SHIFT], __ATOMIC_ACQUIRE);
+    if (node == NULL)
+        return NULL;
+    GmdLeaf *leaf = __atomic_load_n(&node->leaves[(idx >> GMD_LEAF_BITS) & ((1 << GMD_NODE_BITS) - 1)], __ATOMIC_ACQUIRE);
+    if (leaf == NULL)
+        return NULL;
+    TranslationPage *t_page = __atomic_load_n(&leaf->slots[idx & ((1 << GMD_LEAF_BITS) - 1)], __ATOMIC_ACQUIRE);
+    if ((uintptr_t)t_page & (GMD_SNAPSHOT_TAG | GMD_PAGED_OUT))
+        return gmd_fault(kvssd, idx);
+    return t_page;
+}
+
 // Function Prototypes
 void init_KVSSD(KVSSD *ssd, uint64_t capacity, int page_size, int slab_size, int threshold);
+void init_KVSSD_sharded(KVSSD *ssd, uint64_t capacity, int page_size, int slab_size, int threshold, int shards);
+void init_KVSSD_cow(KVSSD *ssd, uint64_t capacity, int page_size, int slab_size, int threshold, int shards);
+void init_KVSSD_cached(KVSSD *ssd, uint64_t capacity, int page_size, int slab_size, int threshold, const char *path, int frames);
+void init_KVSSD_cuckoo(KVSSD *ssd, uint64_t capacity, int page_size, int slab_size, int threshold);
+KVSSDCacheStats kvssd_cache_stats(KVSSD *kvssd);
+void kvssd_track_latency(KVSSD *kvssd, bool on);
+LatencySummary kvssd_latency(KVSSD *kvssd, int path);
+const char *latency_path_name(int path);
+bool kvssd_set_filter(KVSSD *kvssd, uint64_t bytes);
+KVSSDCounters kvssd_counters(KVSSD *kvssd);
+void set_gmd_workers(KVSSD *kvssd, int workers);
+void clear_KVSSD(KVSSD *ssd);
+void free_KVSSD(KVSSD *ssd);
 int gmd_size(KVSSD *kvssd);
 uint64_t hash_k(const char *key);
-int get_translation_page(KVSSD *ssd, uint64_t key_hash);
+void hash_k_batch(const char *const *keys, const int *lens, int n, uint64_t *out);
+uint64_t get_translation_page(KVSSD *ssd, uint64_t key_hash);
 bool write(KVSSD *kvssd, const char *key, int klen, int val, int vlen);
+void write_batch(KVSSD *kvssd, const kv_op *ops, int n, bool *results);
 bool read(KVSSD *kvssd, const char *key);
+void read_batch(KVSSD *kvssd, const char *const *keys, int n, bool *results);
 bool delete(KVSSD *kvssd, const char *key);
 double get_avg_kv(KVSSD *kvssd);
+int get_kv_percentile(KVSSD *kvssd, double percentile);
 void update_threshold(KVSSD *kvssd);
+KVSSDStats kvssd_stats(KVSSD *kvssd);
 void get_stats(KVSSD *kvssd);
+bool save_KVSSD(KVSSD *kvssd, const char *path);
+bool load_KVSSD(KVSSD *ssd, const char *path);
+bool kvssd_open_wal(KVSSD *kvssd, const char *path, int batch, int interval_us, bool wait);
+bool kvssd_sync_wal(KVSSD *kvssd);
+void kvssd_close_wal(KVSSD *kvssd);
+long replay_wal(KVSSD *kvssd, const char *path);
@@ -1,8 +1,25 @@
 #include "TranslationPage.h"
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Number of heap allocations made by this file, see tp_alloc_count
+static size_t alloc_count = 0;
+
+static void* tp_malloc(size_t size) {
+    alloc_count++;
+    return malloc(size);
+}
+
+// Returns how many allocations translation pages have made so far. Once a page exists
+// insert/delete/read on it never allocate, keys live in the page's arena
+size_t tp_alloc_count(void) {
+    return alloc_count;
+}
 
 void print_tp_stats(TranslationPage *tp){
     printf("\n=== STATS ===\n");
-    printf("Total D-Entries: %d\n", tp->dentry_idx);
+    printf("Total D-Entries: %d\n", tp->dentry_count);
     printf("Total D-Entry Slabs Used: %d\n", tp->d_entry_slabs);
     printf("Total I-Entries: %d\n", tp->i_entry_count);
     printf("Total Evictions: %d\n", tp->evictions);
@@ -18,10 +35,10 @@ void print_tp_stats(TranslationPage *tp){
 }
 
 // Debugging functions
-void print_dentry(DEntry entry) {
+void print_dentry(TranslationPage *tp, DEntry entry) {
     printf("DEntry - key_hash: %llu, key: %s, val: %d, klen: %d, vlen: %d, num_slabs: %d\n", 
            entry.key_hash, 
-           entry.key, 
+           dentry_key(tp, &entry), 
            entry.val, 
            entry.klen, 
            entry.vlen, 
@@ -30,18 +47,18 @@ void print_dentry(DEntry entry) {
 
 void print_dentries(TranslationPage *tp){
     printf("\n=== D-Entries ===\n");
-    for (int i = 0; i < tp->dentry_idx; i++){
+    for (int i = next_dentry(tp, 0); i != -1; i = next_dentry(tp, i + 1)){
         DEntry entry = tp->d_entries[i];
-        print_dentry(entry);
+        print_dentry(tp, entry);
     }
-    printf("Total D-Entries: %d\n", tp->dentry_idx);
+    printf("Total D-Entries: %d\n", tp->dentry_count);
 }
 
 void print_ientries(TranslationPage *tp){
     printf("\n=== I-Entries ===\n");
-    for (int i = 0; i < tp->i_entries->size; i++) {
-        if (tp->i_entries->table[i].is_occupied) {
-            printf("Key Hash: %llu\n", tp->i_entries->table[i].key_hash);
+    for (int i = 0; i < tp->key_hashes->size; i++) {
+        if (tp->key_hashes->table[i].type == I_ENTRY) {
+            printf("Key Hash: %llu\n", tp->key_hashes->table[i].key_hash);
         }
     }
     printf("Total I-Entries: %d\n", tp->i_entry_count);
@@ -50,14 +67,14 @@ void print_ientries(TranslationPage *tp){
 void print_key_hashes(TranslationPage *tp){
     printf("\n=== Key Hash Mappings ===\n");
     for (int i = 0; i < tp->key_hashes->size; i++) {
-        if (tp->key_hashes->table[i].is_occupied) {
+        if (tp->key_hashes->table[i].type != EMPTY_ENTRY) {
             printf("Key Hash: %llu, Idx: %d", 
                    tp->key_hashes->table[i].key_hash, 
-                   tp->key_hashes->table[i].value);
-            // Add clarification for special values
-            if (tp->key_hashes->table[i].value == -1) {
+                   tp->key_hashes->table[i].slot);
+            // Add clarification for the entry type
+            if (tp->key_hashes->table[i].type == I_ENTRY) {
                 printf(" (I-Entry)");
-            } else if (tp->key_hashes->table[i].value >= 0) {
+            } else {
                 printf(" (D-Entry)");
             }
             printf("\n");
@@ -65,174 +82,264 @@ void print_key_hashes(TranslationPage *tp){
     }
 }
 
-// Create hashmap of size tt_slab
+// Returns the log2 of the smallest power of two table that keeps `entries` at or below the max load factor
+static int table_bits(int entries) {
+    int bits = 1;
+    while ((1 << bits) * MAX_LOAD_NUM < entries * MAX_LOAD_DEN)
+        bits++;
+    return bits;
+}
+
+// Sets up map over a table of 2^bits entries and its 2^bits + CTRL_TAIL control bytes
+static void init_hashmap(HashMap *map, HashMapEntry *table, uint8_t *ctrl, int bits) {
+    map->table = table;
+    map->ctrl = ctrl;
+    map->size = 1 << bits;
+    map->mask = map->size - 1;
+    map->shift = 64 - bits;
+    map->count = 0;
+
+    for (int i = 0; i < map->size; i++) {
+        map->table[i].type = EMPTY_ENTRY; // Mark as not occupied
+        map->table[i].key_hash = 0; // Initialize key_hash to 0 (or another invalid value)
+        map->table[i].slot = NOT_FOUND; // Initialize slot to NOT_FOUND (-2 or another special value)
+    }
+    memset(ctrl, CTRL_EMPTY, map->size + CTRL_TAIL);
+}
+
+// Create hashmap that can hold `size` entries (tt_slab) without going above the max load factor
 HashMap* create_hashmap(int size) {
-    HashMap *map = (HashMap*)malloc(sizeof(HashMap));
+    HashMap *map = (HashMap*)tp_malloc(sizeof(HashMap));
     if (map == NULL) {
         fprintf(stderr, "Failed to allocate memory for HashMap\n");
         exit(1); // Or handle error accordingly
     }
-    map->table = (HashMapEntry*)malloc(size * sizeof(HashMapEntry));
-    if (map->table == NULL){
+    int bits = table_bits(size);
+    // Control bytes right after the table, free(map->table) releases both
+    HashMapEntry *table = (HashMapEntry*)tp_malloc(((size_t)1 << bits) * sizeof(HashMapEntry) + ((size_t)1 << bits) + CTRL_TAIL);
+    if (table == NULL){
         fprintf(stderr, "Failed to allocate memory for HashMap table\n");
         exit(1); // Or handle error accordingly        
     }
-    map->size = size;
-
-    for (int i = 0; i < size; i++) {
-        map->table[i].is_occupied = false; // Mark as not occupied
-        map->table[i].key_hash = 0; // Initialize key_hash to 0 (or another invalid value)
-        map->table[i].value = NOT_FOUND; // Initialize value to NOT_FOUND (-2 or another special value)
-    }
+    init_hashmap(map, table, (uint8_t*)(table + ((size_t)1 << bits)), bits);
 
     return map;
 }
 
-// Simple hash function
-int hash_function_map(uint64_t key_hash, int table_size) {
-    return key_hash % table_size;
+// Fibonacci hash on the high bits. Every key_hash in a translation page shares the same
+// value mod gmd_len, so the low bits can't be used directly as a slot index
+int hash_function_map(uint64_t key_hash, int shift) {
+    return (int)((key_hash * 0x9E3779B97F4A7C15ULL) >> shift);
 }
 
-// put method
-void hashmap_put(HashMap *map, uint64_t key_hash, int value) {
-    int index = hash_function_map(key_hash, map->size);
-
-    while (map->table[index].is_occupied && map->table[index].key_hash != key_hash) {
-        index = (index + 1) % map->size;
-    }
-
-    // Insert or update the key_hash -> value pair
-    map->table[index].key_hash = key_hash;
-    map->table[index].value = value;
-    map->table[index].is_occupied = true;
+// Control byte of key_hash: the 7 bits of the product right below the ones that picked its slot
+static inline uint8_t hash_fingerprint(uint64_t key_hash, int shift) {
+    return (uint8_t)((key_hash * 0x9E3779B97F4A7C15ULL) >> (shift - 7)) & 0x7f;
 }
 
-// Function to get the value associated with a key_hash
-// Returns -2 (NOT_FOUND) if the key_hash is not found
-int hashmap_get(HashMap *map, uint64_t key_hash) {
-    int index = hash_function_map(key_hash, map->size);
-
-    while (map->table[index].is_occupied) {
-        if (map->table[index].key_hash == key_hash) {
-            return map->table[index].value;  // Found: return the value (either -1 or a valid index)
-        }
-        index = (index + 1) % map->size;
-    }
-
-    // Key not found
-    return NOT_FOUND;
+// Writes the control byte of slot i and its copies in the tail
+static inline void set_ctrl(HashMap *map, int i, uint8_t c) {
+    map->ctrl[i] = c;
+    for (int m = i + map->size; m < map->size + CTRL_TAIL; m += map->size)
+        map->ctrl[m] = c;
 }
 
-// Function to delete a key_hash from the hashmap
-void hashmap_delete(HashMap *map, uint64_t key_hash) {
-    int index = hash_function_map(key_hash, map->size);
-
-    while (map->table[index].is_occupied) {
-        if (map->table[index].key_hash == key_hash) {
-            // Mark the entry as deleted (set a special value for "deleted")
-            map->table[index].is_occupied = false;
-            map->table[index].value = NOT_FOUND;
-            return;
-        }
-        index = (index + 1) % map->size;
-    }
+// Group probing: a lookup compares CTRL_GROUP control bytes at once with the fingerprint and
+// only reads the slots that match. ctrl_match and ctrl_empty return a mask with bit
+// (i << CTRL_BIT_SHIFT) set for byte i of the group
+#if defined(__AVX2__)
+#define CTRL_GROUP 32
+#define CTRL_BIT_SHIFT 0
+typedef uint32_t ctrl_mask;
+
+static inline ctrl_mask ctrl_match(const uint8_t *g, uint8_t c) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)g);
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)c)));
 }
 
-// Function to create a hash set with a dynamic size
-HashSet* create_hash_set(int size) {
-    HashSet *set = (HashSet*)malloc(sizeof(HashSet));
-    if (set == NULL){
-        fprintf(stderr, "Failed to allocate memory for Hashset\n");
-        exit(1); // Or handle error accordingly
-    }
-    set->table = (HashSetEntry*)malloc(size * sizeof(HashSetEntry));
-    if (set->table == NULL){
-        fprintf(stderr, "Failed to allocate memory for Hashset table\n");
-        exit(1); // Or handle error accordingly
-    }
-    set->size = size;
-
-    // Initialize all slots as empty
-    for (int i = 0; i < size; i++) {
-        set->table[i].is_occupied = false;
-    }
+static inline ctrl_mask ctrl_empty(const uint8_t *g) {
+    return (uint32_t)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)g));
+}
+#elif defined(__SSE2__)
+#define CTRL_GROUP 16
+#define CTRL_BIT_SHIFT 0
+typedef uint32_t ctrl_mask;
+
+static inline ctrl_mask ctrl_match(const uint8_t *g, uint8_t c) {
+    __m128i v = _mm_loadu_si128((const __m128i*)g);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)c)));
+}
 
-    return set;
+static inline ctrl_mask ctrl_empty(const uint8_t *g) {
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)g));
+}
+#else
+// 8 bytes in a word. The zero byte test may also flag a byte right after a real match,
+// which costs a key_hash compare and nothing else
+#define CTRL_GROUP 8
+#define CTRL_BIT_SHIFT 3
+typedef uint64_t ctrl_mask;
+
+static inline ctrl_mask ctrl_match(const uint8_t *g, uint8_t c) {
+    uint64_t w;
+    memcpy(&w, g, 8);
+    w ^= 0x0101010101010101ULL * c;
+    return (w - 0x0101010101010101ULL) & ~w & 0x8080808080808080ULL;
 }
 
-// Hash function to map key_hash to an index
-int hash_function(uint64_t key_hash, int table_size) {
-    return key_hash % table_size;
+static inline ctrl_mask ctrl_empty(const uint8_t *g) {
+    uint64_t w;
+    memcpy(&w, g, 8);
+    return w & 0x8080808080808080ULL;
 }
+#endif
+
+// put method, inserts or retags the entry for key_hash
+void hashmap_put(HashMap *map, uint64_t key_hash, uint8_t type, int slot) {
+    HashMapEntry *entry = hashmap_find(map, key_hash);
+    int index;
+    if (entry != NULL) {
+        index = entry - map->table;
+    } else {
+        index = hash_function_map(key_hash, map->shift);
+        while (map->ctrl[index] != CTRL_EMPTY)
+            index = (index + 1) & map->mask;
+        assert(map->count < map->mask); // always keep one empty slot so probes terminate
+        map->count++;
+        set_ctrl(map, index, hash_fingerprint(key_hash, map->shift));
+    }
 
-// Function to insert a key_hash into the set
-void hash_set_put(HashSet *set, uint64_t key_hash) {
-    int index = hash_function(key_hash, set->size);
+    // Insert or update the key_hash -> (type, slot) pair
+    map->table[index].key_hash = key_hash;
+    map->table[index].slot = slot;
+    map->table[index].type = type;
+}
 
-    // Linear probing in case of collision
-    while (set->table[index].is_occupied) {
-        if (set->table[index].key_hash == key_hash) {
-            // Key already exists in the set
-            return;
+// Returns the entry for key_hash (D or I), or NULL if the key_hash is not in the page.
+// The home slot is checked first, like the plain linear probe did: most hits and many misses
+// end there, in one cache line and without the control bytes. Past it the probe goes a group
+// of control bytes at a time, and only reads the slots whose fingerprint matches, up to the
+// first free one
+HashMapEntry* hashmap_find(HashMap *map, uint64_t key_hash) {
+    int index = hash_function_map(key_hash, map->shift);
+    HashMapEntry *home = &map->table[index];
+    if (home->type == EMPTY_ENTRY)
+        return NULL; // Key not found
+    if (home->key_hash == key_hash)
+        return home;
+
+    uint8_t fingerprint = hash_fingerprint(key_hash, map->shift);
+
+    for (;;) {
+        const uint8_t *group = map->ctrl + index;
+        ctrl_mask empty = ctrl_empty(group);
+        ctrl_mask match = ctrl_match(group, fingerprint);
+        if (empty)
+            match &= (empty & -empty) - 1; // the probe ends at the first free slot
+        for (; match; match &= match - 1) {
+            int i = (index + (__builtin_ctzll(match) >> CTRL_BIT_SHIFT)) & map->mask;
+            if (map->table[i].key_hash == key_hash)
+                return &map->table[i];
         }
-        index = (index + 1) % set->size;
+        if (empty)
+            return NULL; // Key not found
+        index = (index + CTRL_GROUP) & map->mask;
     }
-
-    // Insert the new key_hash
-    set->table[index].key_hash = key_hash;
-    set->table[index].is_occupied = true;
 }
 
-// Function to check if a key_hash is in the set
-bool hash_set_contains(HashSet *set, uint64_t key_hash) {
-    int index = hash_function(key_hash, set->size);
+// Function to get the d_entries index associated with a key_hash
+// Returns -1 for an I-entry and -2 (NOT_FOUND) if the key_hash is not found
+int hashmap_get(HashMap *map, uint64_t key_hash) {
+    HashMapEntry *entry = hashmap_find(map, key_hash);
+    if (entry == NULL)
+        return NOT_FOUND;
+    return entry->type == D_ENTRY ? entry->slot : -1;
+}
 
-    // Linear probing to search for the key
-    while (set->table[index].is_occupied) {
-        if (set->table[index].key_hash == key_hash) {
-            return true;  // Found the key
+// Function to delete a key_hash from the hashmap
+// Uses backward shift deletion: entries after the hole are moved back if the hole lies on
+// their probe path, so no tombstones are needed and later lookups never stop early
+void hashmap_delete(HashMap *map, uint64_t key_hash) {
+    HashMapEntry *entry = hashmap_find(map, key_hash);
+    if (entry == NULL)
+        return;
+
+    int hole = entry - map->table;
+    int next = (hole + 1) & map->mask;
+    while (map->ctrl[next] != CTRL_EMPTY) {
+        int home = hash_function_map(map->table[next].key_hash, map->shift);
+        // move entry back if its home is not in (hole, next]
+        if (((next - home) & map->mask) >= ((next - hole) & map->mask)) {
+            map->table[hole] = map->table[next];
+            set_ctrl(map, hole, map->ctrl[next]);
+            hole = next;
         }
-        index = (index + 1) % set->size;
+        next = (next + 1) & map->mask;
     }
-
-    return false;  // Key not found
+    map->table[hole].type = EMPTY_ENTRY;
+    map->table[hole].key_hash = 0;
+    map->table[hole].slot = NOT_FOUND;
+    set_ctrl(map, hole, CTRL_EMPTY);
+    map->count--;
 }
 
-// Function to delete a key_hash from the set
-void hash_set_delete(HashSet *set, uint64_t key_hash) {
-    int index = hash_function(key_hash, set->size);
+#define ALIGN_UP(x, a) (((x) + (a) - 1) / (a) * (a))
+
+// Byte offsets of the parts of a translation page inside its single allocation
+typedef struct {
+    size_t key_hashes;
+    size_t ctrl;
+    size_t d_entries;
+    size_t d_used;
+    size_t table;
+    size_t keys;
+    size_t total;
+} PageLayout;
+
+static PageLayout page_layout(int page_size, int slab_size) {
+    int tt_slab = page_size / slab_size;
+    PageLayout layout;
+    layout.key_hashes = ALIGN_UP(sizeof(TranslationPage), 8);
+    // Control bytes right behind the key_hashes header, prefetch_page_index brings in the first of them
+    layout.ctrl = layout.key_hashes + sizeof(HashMap);
+    layout.d_entries = ALIGN_UP(layout.ctrl + ((size_t)1 << table_bits(tt_slab)) + CTRL_TAIL, 8);
+    layout.d_used = layout.d_entries + ALIGN_UP(tt_slab * sizeof(DEntry), 8);
+    layout.table = layout.d_used + (tt_slab + 63) / 64 * sizeof(uint64_t);
+    layout.keys = layout.table + ((size_t)1 << table_bits(tt_slab)) * sizeof(HashMapEntry);
+    // D-entry keys never take more than the page plus a terminator each
+    layout.total = ALIGN_UP(layout.keys + page_size + tt_slab, 64);
+    return layout;
+}
 
-    // Linear probing to find the key
-    while (set->table[index].is_occupied) {
-        if (set->table[index].key_hash == key_hash) {
-            set->table[index].is_occupied = false;  // Mark the slot as empty
-            return;
-        }
-        index = (index + 1) % set->size;
-    }
+// Size of the single allocation that holds a whole translation page (header, entries, index, keys)
+size_t translation_page_bytes(int page_size, int slab_size) {
+    return page_layout(page_size, slab_size).total;
 }
 
-// TranslationPage Constructor:
-TranslationPage* create_translation_page(int page_size, int slab_size, int threshold) {
-    TranslationPage *tp = malloc(sizeof(TranslationPage));
-    if (!tp) {
-        fprintf(stderr, "Memory allocation failed for TranslationPage\n");
-        return NULL;
-    }
+// Builds an empty translation page inside mem, which must hold translation_page_bytes() bytes
+TranslationPage* init_translation_page(void *mem, int page_size, int slab_size, int threshold) {
+    PageLayout layout = page_layout(page_size, slab_size);
+    char *base = (char*)mem;
+    TranslationPage *tp = (TranslationPage*)base;
 
     tp->threshold = threshold;
+    tp->page_size = page_size;
     tp->slab_size = slab_size; 
     tp->tt_slab = page_size / slab_size;
 
-    tp->d_entries = (DEntry*)malloc(tp->tt_slab * sizeof(DEntry));
-    if (tp->d_entries == NULL){
-        fprintf(stderr, "Failed to allocate memory for d_entries\n");
-        exit(1); // Or handle error accordingly
-    }
-    tp->i_entries = create_hash_set(tp->tt_slab); 
-    tp->key_hashes = create_hashmap(tp->tt_slab);
+    tp->d_entries = (DEntry*)(base + layout.d_entries);
+    tp->d_used = (uint64_t*)(base + layout.d_used);
+    memset(tp->d_used, 0, layout.table - layout.d_used);
+    tp->key_hashes = (HashMap*)(base + layout.key_hashes);
+    init_hashmap(tp->key_hashes, (HashMapEntry*)(base + layout.table), (uint8_t*)(base + layout.ctrl), table_bits(tp->tt_slab));
 
-    tp->dentry_idx = 0; 
+    tp->keys = base + layout.keys;
+    tp->keys_size = page_size + tp->tt_slab;
+    tp->keys_used = 0;
+    tp->keys_live = 0;
+
+    tp->dentry_count = 0; 
+    tp->evict_cursor = 0;
     tp->d_entry_slabs = 0;
     tp->i_entry_count = 0;
     tp->evictions = 0;
@@ -249,15 +356,188 @@ TranslationPage* create_translation_page(int page_size, int slab_size, int thres
     return tp;
 }
 
-DEntry create_dentry(uint64_t key_hash, const char *key_str, int val, int klen, int vlen, int num_slabs) {
-    DEntry new_entry;
-    new_entry.key_hash = key_hash;
-    new_entry.key = malloc(strlen(key_str) + 1); 
-    if (new_entry.key == NULL) {
-        fprintf(stderr, "Memory allocation for key failed\n");
+// Points the page copied or mapped into mem at its own entries, index and keys
+TranslationPage* rebase_translation_page(void *mem) {
+    char *base = (char*)mem;
+    TranslationPage *tp = (TranslationPage*)base;
+    PageLayout layout = page_layout(tp->page_size, tp->slab_size);
+
+    tp->d_entries = (DEntry*)(base + layout.d_entries);
+    tp->d_used = (uint64_t*)(base + layout.d_used);
+    tp->key_hashes = (HashMap*)(base + layout.key_hashes);
+    tp->key_hashes->table = (HashMapEntry*)(base + layout.table);
+    tp->key_hashes->ctrl = (uint8_t*)(base + layout.ctrl);
+    tp->keys = base + layout.keys;
+    return tp;
+}
+
+// Copies src into mem, which must hold translation_page_bytes() bytes, and points the copy at
+// its own entries, index and keys. Only the used part of the key arena is copied
+TranslationPage* copy_translation_page(void *mem, TranslationPage *src) {
+    PageLayout layout = page_layout(src->page_size, src->slab_size);
+    memcpy(mem, src, layout.keys + src->keys_used);
+    return rebase_translation_page(mem);
+}
+
+// Writes a position independent image of tp to out, which must hold translation_page_bytes()
+// bytes: the page with its internal pointers cleared and the unused key arena zeroed.
+// rebase_translation_page makes it a page again wherever it is loaded
+void translation_page_image(TranslationPage *tp, void *out) {
+    PageLayout layout = page_layout(tp->page_size, tp->slab_size);
+    size_t used = layout.keys + tp->keys_used;
+    char *base = (char*)out;
+    TranslationPage *image = (TranslationPage*)base;
+
+    memcpy(base, tp, used);
+    memset(base + used, 0, layout.total - used);
+    image->d_entries = NULL;
+    image->d_used = NULL;
+    image->key_hashes = NULL;
+    ((HashMap*)(base + layout.key_hashes))->table = NULL;
+    ((HashMap*)(base + layout.key_hashes))->ctrl = NULL;
+    image->keys = NULL;
+}
+
+// TranslationPage Constructor (one allocation, release with free())
+TranslationPage* create_translation_page(int page_size, int slab_size, int threshold) {
+    void *mem = tp_malloc(translation_page_bytes(page_size, slab_size));
+    if (!mem) {
+        fprintf(stderr, "Memory allocation failed for TranslationPage\n");
+        return NULL;
+    }
+
+    return init_translation_page(mem, page_size, slab_size, threshold);
+}
+
+// Sets up a pool that hands out translation pages carved from regions of pages_per_region pages
+void init_page_pool(PagePool *pool, int page_size, int slab_size, int pages_per_region) {
+    pool->page_size = page_size;
+    pool->slab_size = slab_size;
+    pool->page_bytes = translation_page_bytes(page_size, slab_size);
+    pool->pages_per_region = pages_per_region;
+    pool->regions = NULL;
+    pool->region_count = 0;
+    pool->next = NULL;
+    pool->left = 0;
+    pool->free_list = NULL;
+    pool->pages_in_use = 0;
+}
+
+// Reserves a new region, the first cache line holds the link to the previous region
+static void page_pool_grow(PagePool *pool) {
+    char *region = tp_malloc(64 + pool->page_bytes * pool->pages_per_region + 63);
+    if (region == NULL) {
+        fprintf(stderr, "Failed to allocate memory for page pool region\n");
         exit(1);
     }
-    strcpy(new_entry.key, key_str); 
+    *(char**)region = pool->regions;
+    pool->regions = region;
+    pool->region_count++;
+
+    uintptr_t first = ((uintptr_t)region + 64 + 63) & ~(uintptr_t)63;
+    pool->next = (char*)first;
+    pool->left = pool->pages_per_region;
+}
+
+// Memory for one page, reusing a released one when there is one
+static void* page_pool_take(PagePool *pool) {
+    void *mem;
+    if (pool->free_list != NULL) {
+        mem = pool->free_list;
+        pool->free_list = *(void**)mem;
+    } else {
+        if (pool->left == 0)
+            page_pool_grow(pool);
+        mem = pool->next;
+        pool->next += pool->page_bytes;
+        pool->left--;
+    }
+    pool->pages_in_use++;
+    return mem;
+}
+
+// Returns an empty translation page
+TranslationPage* page_pool_alloc(PagePool *pool, int threshold) {
+    return init_translation_page(page_pool_take(pool), pool->page_size, pool->slab_size, threshold);
+}
+
+// Returns a copy of src, which must be a page of the same size
+TranslationPage* page_pool_copy(PagePool *pool, TranslationPage *src) {
+    return copy_translation_page(page_pool_take(pool), src);
+}
+
+// Gives a page back to the pool, its memory is reused by the next page_pool_alloc
+void page_pool_free(PagePool *pool, TranslationPage *tp) {
+    *(void**)tp = pool->free_list;
+    pool->free_list = tp;
+    pool->pages_in_use--;
+}
+
+// Frees every region, all pages handed out by the pool become invalid
+void destroy_page_pool(PagePool *pool) {
+    while (pool->regions != NULL) {
+        char *prev = *(char**)pool->regions;
+        free(pool->regions);
+        pool->regions = prev;
+    }
+    init_page_pool(pool, pool->page_size, pool->slab_size, pool->pages_per_region);
+}
+
+static int compare_key_off(const void *a, const void *b) {
+    return ((const int*)a)[0] - ((const int*)b)[0];
+}
+
+// Slides all live keys to the front of the arena, in arena order so no key is overwritten
+static void compact_keys(TranslationPage *tp) {
+    if (tp->dentry_count == 0) {
+        tp->keys_used = 0;
+        return;
+    }
+
+    int order[tp->dentry_count][2]; // (key_off, slot)
+    int n = 0;
+    for (int i = next_dentry(tp, 0); i != -1; i = next_dentry(tp, i + 1)) {
+        order[n][0] = tp->d_entries[i].key_off;
+        order[n][1] = i;
+        n++;
+    }
+    qsort(order, n, sizeof(order[0]), compare_key_off);
+
+    int used = 0;
+    for (int i = 0; i < n; i++) {
+        DEntry *entry = &tp->d_entries[order[i][1]];
+        memmove(tp->keys + used, tp->keys + entry->key_off, entry->key_len + 1);
+        entry->key_off = used;
+        used += entry->key_len + 1;
+    }
+    tp->keys_used = used;
+}
+
+// Copies key into the page's key arena, returns its offset or -1 if it doesn't fit
+int alloc_key(TranslationPage *tp, const char *key, int key_len) {
+    int needed = key_len + 1;
+    if (tp->keys_used + needed > tp->keys_size) {
+        if (tp->keys_live + needed > tp->keys_size)
+            return -1;
+        compact_keys(tp);
+    }
+
+    int off = tp->keys_used;
+    memcpy(tp->keys + off, key, needed);
+    tp->keys_used += needed;
+    tp->keys_live += needed;
+    return off;
+}
+
+const char* dentry_key(TranslationPage *tp, DEntry *entry) {
+    return tp->keys + entry->key_off;
+}
+
+DEntry create_dentry(uint64_t key_hash, int key_off, int key_len, int val, int klen, int vlen, int num_slabs) {
+    DEntry new_entry;
+    new_entry.key_hash = key_hash;
+    new_entry.key_off = key_off;
+    new_entry.key_len = key_len;
     new_entry.val = val;
     new_entry.klen = klen;
     new_entry.vlen = vlen;
@@ -265,30 +545,39 @@ DEntry create_dentry(uint64_t key_hash, const char *key_str, int val, int klen,
     return new_entry;
 }
 
-// Updates indexes of key_hashes to reflect change in d_entries array
-void update_key_hashes(TranslationPage *tp) {
-    //print_dentries(tp);
-    
-    // Clear the existing key_hashes hashmap before updating
-    for (int i = 0; i < tp->key_hashes->size; i++) {
-        tp->key_hashes->table[i].is_occupied = false;
-        tp->key_hashes->table[i].key_hash = 0;
-        tp->key_hashes->table[i].value = NOT_FOUND;
+// Returns the first occupied d_entries slot >= slot, or -1 if there is none
+int next_dentry(TranslationPage *tp, int slot) {
+    int words = (tp->tt_slab + 63) / 64;
+    int w = slot / 64;
+    if (w >= words)
+        return -1;
+
+    uint64_t bits = tp->d_used[w] & (~0ULL << (slot % 64));
+    while (bits == 0) {
+        if (++w >= words)
+            return -1;
+        bits = tp->d_used[w];
     }
+    return w * 64 + __builtin_ctzll(bits);
+}
 
-    // Update key_hashes based on the current d_entries
-    for (int i = 0; i < tp->dentry_idx; i++) {  // Use dentry_idx instead of tt_slab
-        if (tp->d_entries[i].key_hash != 0) {    // Skip empty/deleted entries
-            hashmap_put(tp->key_hashes, tp->d_entries[i].key_hash, i);
+// Returns a free d_entries slot (there is always one while the page has free slabs)
+static int free_dentry_slot(TranslationPage *tp) {
+    int words = (tp->tt_slab + 63) / 64;
+    for (int w = 0; w < words; w++) {
+        if (~tp->d_used[w] != 0) {
+            int slot = w * 64 + __builtin_ctzll(~tp->d_used[w]);
+            return slot < tp->tt_slab ? slot : -1;
         }
     }
+    return -1;
 }
 
-bool check_hash_collision(int idx ,TranslationPage *tp, const char *key){
+bool check_hash_collision(HashMapEntry *entry, TranslationPage *tp, const char *key){
     // check for hash_collision (doesn't work for I-entry)
-    char* oldK;
-    if (idx != -1) // Check D-entry collision
-        oldK = tp->d_entries[idx].key;
+    const char* oldK = NULL;
+    if (entry->type == D_ENTRY) // Check D-entry collision
+        oldK = dentry_key(tp, &tp->d_entries[entry->slot]);
 
     //else
     // Handle I-entry collision (might not be possible)
@@ -302,24 +591,68 @@ bool check_hash_collision(int idx ,TranslationPage *tp, const char *key){
     return false;
 }
 
+// Frees the slot of a D-entry without touching key_hashes
+static void release_dentry_slot(TranslationPage *tp, int idx) {
+    tp->d_entry_slabs -= tp->d_entries[idx].num_slabs;
+    tp->dentry_count--;
+    tp->keys_live -= tp->d_entries[idx].key_len + 1;
+
+    tp->d_used[idx / 64] &= ~(1ULL << (idx % 64));
+    tp->d_entries[idx].key_hash = 0;  // Reset key_hash
+    tp->d_entries[idx].val = 0;       // Reset value
+    tp->d_entries[idx].klen = 0;      // Reset key length
+    tp->d_entries[idx].vlen = 0;      // Reset value length
+    tp->d_entries[idx].num_slabs = 0; // Reset slab count
+}
+
+// Turns a D-entry into an I-entry by retagging its key_hashes entry in place
+static void convert_dentry_to_ientry(TranslationPage *tp, HashMapEntry *entry) {
+    release_dentry_slot(tp, entry->slot);
+    entry->type = I_ENTRY;
+    entry->slot = -1;
+    tp->i_entry_count++;
+    tp->inserts++;
+}
+
+// Turns an I-entry into a D-entry, caller checks that the slabs fit
+static bool convert_ientry_to_dentry(TranslationPage *tp, HashMapEntry *entry, int klen, int vlen, const char *key, int val, int slabs_needed) {
+    int slot = free_dentry_slot(tp);
+    if (slot == -1)
+        return false;
+    int key_len = strlen(key);
+    int key_off = alloc_key(tp, key, key_len);
+    if (key_off == -1)
+        return false;
+    tp->d_entries[slot] = create_dentry(entry->key_hash, key_off, key_len, val, klen, vlen, slabs_needed);
+    tp->d_used[slot / 64] |= 1ULL << (slot % 64);
+    entry->type = D_ENTRY;
+    entry->slot = slot;
+
+    tp->i_entry_count--;
+    tp->dentry_count++;
+    tp->d_entry_slabs += slabs_needed;
+    tp->inserts++;
+    return true;
+}
+
 bool insert(TranslationPage *tp, uint64_t key_hash, int klen, int vlen, const char *key, int val) {
     int slabs_needed = ceil((double)(klen + vlen) / tp->slab_size);
 
-    // if key_hash exists update
-    if(hashmap_get(tp->key_hashes, key_hash) != NOT_FOUND){ 
-        int idx = hashmap_get(tp->key_hashes, key_hash);  // returns -2 for not found, -1 for Ientry, Index for Dentry
+    // if key_hash exists update (one probe tells us whether it is a D-entry or an I-entry)
+    HashMapEntry *entry = hashmap_find(tp->key_hashes, key_hash);
+    if(entry != NULL){ 
+        int idx = entry->slot;
         
         // if a hash collision happens (we try to update entry with different key)
-        if(check_hash_collision(idx, tp, key))
+        if(check_hash_collision(entry, tp, key))
             return false;
 
         // Update D-entry
-        if (idx != -1 && idx != NOT_FOUND && idx < tp->dentry_idx) { 
+        if (entry->type == D_ENTRY) { 
             // Case 1, Convert D-entry to I-entry
             if (klen + vlen > tp->threshold) {
                 //printf("Updating D-entry to I-entry\n");
-                delete_dentry(tp, key_hash); // delete current d-entry
-                insert_ientry(tp, key_hash); // insert it as new i-entry
+                convert_dentry_to_ientry(tp, entry);
                 tp->evictions++;
             } 
 
@@ -346,8 +679,7 @@ bool insert(TranslationPage *tp, uint64_t key_hash, int klen, int vlen, const ch
                 //printf("Updating D-entry to more slabs\n");
                 int difference = slabs_needed - tp->d_entries[idx].num_slabs;
                 if (tp->d_entry_slabs + tp->i_entry_count + difference > tp->tt_slab){
-                    delete_dentry(tp, key_hash); // delete current d-entry
-                    insert_ientry(tp, key_hash); // insert it as i-entry
+                    convert_dentry_to_ientry(tp, entry); // keep it as an i-entry
                     tp->evictions++;
                 } else{
                     tp->d_entries[idx].num_slabs = slabs_needed;
@@ -364,7 +696,7 @@ bool insert(TranslationPage *tp, uint64_t key_hash, int klen, int vlen, const ch
         }
 
         // Update I-entry
-        else if (idx == -1){
+        else {
             // i-entry becomes d-entry
             if (klen + vlen < tp->threshold){
                 //printf("Updating I-entry to D-entry\n");
@@ -372,8 +704,8 @@ bool insert(TranslationPage *tp, uint64_t key_hash, int klen, int vlen, const ch
                     //printf("Not enough space to Update I-entry to D-entry\n");
                     return true; // not enough space
                 }
-                delete_ientry(tp, key_hash); // delete current entry
-                insert_dentry(tp, key_hash, klen, vlen, key, val); // insert it as d-entry
+                if (!convert_ientry_to_dentry(tp, entry, klen, vlen, key, val, slabs_needed))
+                    return true; // key longer than klen and no room left in the key arena, it stays an I-entry like above
             } 
             // I-entry becomes a new I-entry (No need to do anything)
             else{
@@ -427,13 +759,21 @@ bool insert_dentry(TranslationPage *tp, uint64_t key_hash, int klen, int vlen, c
         return false;
     }
     
-// Add dentry to d_entries array and update key_hashes
-    DEntry new_dentry = create_dentry(key_hash, key, val, klen, vlen, slabs_needed);
-    tp->d_entries[tp->dentry_idx] = new_dentry;
-    hashmap_put(tp->key_hashes, key_hash, tp->dentry_idx);
+// Add dentry to a free slot of d_entries and update key_hashes
+    int slot = free_dentry_slot(tp);
+    if (slot == -1)
+        return false;
+    int key_len = strlen(key);
+    int key_off = alloc_key(tp, key, key_len);
+    if (key_off == -1)
+        return false;
+    DEntry new_dentry = create_dentry(key_hash, key_off, key_len, val, klen, vlen, slabs_needed);
+    tp->d_entries[slot] = new_dentry;
+    tp->d_used[slot / 64] |= 1ULL << (slot % 64);
+    hashmap_put(tp->key_hashes, key_hash, D_ENTRY, slot);
 
     // Update counters
-    tp->dentry_idx++;
+    tp->dentry_count++;
     tp->d_entry_slabs += slabs_needed;
     tp->inserts++;
     return true;
@@ -443,16 +783,22 @@ bool insert_dentry(TranslationPage *tp, uint64_t key_hash, int klen, int vlen, c
 bool insert_dentry_by_eviction(TranslationPage *tp, uint64_t key_hash, int klen, int vlen, const char *key, int val) {
     int slabs_needed = ceil((double)(klen + vlen) / tp->slab_size);
     //printf("Inserting D-entry by evicting other D-entry, New d-entry needs: %d slabs\n", slabs_needed);
-    // Look for D-entry of greater size to evict
-    for(int i = 0; i < tp->dentry_idx; i++){
-        if(tp->d_entries[i].num_slabs > slabs_needed){
-            //printf("larger D-entry found, key_hash: %d\n", tp->d_entries[i].key_hash);
-            uint64_t evict_key_hash = tp->d_entries[i].key_hash;
-            delete_dentry(tp, evict_key_hash);
-            insert_dentry(tp, key_hash, klen, vlen, key, val);
-            insert_ientry(tp, evict_key_hash);
-            tp->evictions++;
-            return true;
+    // Look for D-entry of greater size to evict, starting after the last victim so
+    // repeated evictions don't rescan the entries that were just inserted
+    for(int pass = 0; pass < 2; pass++){
+        int start = pass == 0 ? tp->evict_cursor : 0;
+        for(int i = next_dentry(tp, start); i != -1; i = next_dentry(tp, i + 1)){
+            if(pass == 1 && i >= tp->evict_cursor)
+                break;
+            if(tp->d_entries[i].num_slabs > slabs_needed){
+                //printf("larger D-entry found, key_hash: %d\n", tp->d_entries[i].key_hash);
+                convert_dentry_to_ientry(tp, hashmap_find(tp->key_hashes, tp->d_entries[i].key_hash));
+                if (!insert_dentry(tp, key_hash, klen, vlen, key, val) && !insert_ientry(tp, key_hash))
+                    return false; // key longer than klen and no room left in the key arena
+                tp->evict_cursor = i + 1;
+                tp->evictions++;
+                return true;
+            }
         }
     }
 
@@ -470,29 +816,49 @@ bool insert_ientry(TranslationPage *tp, uint64_t key_hash) {
         return false;
     }
 
-    hash_set_put(tp->i_entries, key_hash); // insert key_hash in i_entries
-    hashmap_put(tp->key_hashes, key_hash, -1); // insert key_hash in key_hashes
+    hashmap_put(tp->key_hashes, key_hash, I_ENTRY, -1); // insert key_hash in key_hashes
     tp->i_entry_count++;
     tp->inserts++;
     return true;
 }
 
-// finds value from key_hash
-bool find_value_by_key_hash(TranslationPage *tp, uint64_t key_hash, const char *key) {
-    if (hashmap_get(tp->key_hashes, key_hash) != NOT_FOUND) {  // if key_hash in self.key_hashes: (key_hash exists)
-        int idx = hashmap_get(tp->key_hashes, key_hash);  // Check if key_hash exists
-        if (idx != -1 && idx < tp->dentry_idx) {  // It's a D-entry
+// Type of the entry of key_hash (EMPTY_ENTRY if there is none), without touching the page
+uint8_t key_hash_type(TranslationPage *tp, uint64_t key_hash) {
+    HashMapEntry *entry = hashmap_find(tp->key_hashes, key_hash);
+    return entry == NULL ? EMPTY_ENTRY : entry->type;
+}
+
+// finds value from key_hash: the type of the entry that was read, EMPTY_ENTRY (false) if
+// key_hash is not in the page
+uint8_t find_value_by_key_hash(TranslationPage *tp, uint64_t key_hash) {
+    HashMapEntry *entry = hashmap_find(tp->key_hashes, key_hash);
+    if (entry != NULL) {  // if key_hash in self.key_hashes: (key_hash exists)
+        if (entry->type == D_ENTRY) {  // It's a D-entry
             tp->read_d_entry += 1;  // Increment D-entry read count
-            return true;
+            return D_ENTRY;
         }
         else {  // It's an I-entry
-            assert(hash_set_contains(tp->i_entries, key_hash));  // assert(key_hash in self.i_entries)
             tp->read_i_entry += 1;  // Increment I-entry read count
-            return true;
+            return I_ENTRY;
         }
     }
 
-    return false;  // key_hash not found
+    return EMPTY_ENTRY;  // key_hash not found
+}
+
+// Starts loading the page header and the key_hashes header that follows it (see page_layout),
+// so a later prefetch_key_hash or find_value_by_key_hash doesn't stall on them
+void prefetch_page_index(TranslationPage *tp) {
+    __builtin_prefetch(tp);
+    __builtin_prefetch((char *)tp + sizeof(TranslationPage));
+}
+
+// Starts loading the key_hashes bucket where a lookup of key_hash begins and its control bytes
+void prefetch_key_hash(TranslationPage *tp, uint64_t key_hash) {
+    HashMap *map = tp->key_hashes;
+    int index = hash_function_map(key_hash, map->shift);
+    __builtin_prefetch(&map->ctrl[index]);
+    __builtin_prefetch(&map->table[index]);
 }
 
 // SHOULD BE DONE
@@ -500,43 +866,25 @@ bool delete_dentry(TranslationPage *tp, uint64_t key_hash) {
     //printf("Trying to delete d-entry, key_hash: %d", key_hash);
     //print_dentries(tp);
     //print_key_hashes(tp);
-    int idx = hashmap_get(tp->key_hashes, key_hash);  // -2 = not found, -1 = ientry
-    if (idx == NOT_FOUND || idx == -1) {
+    HashMapEntry *entry = hashmap_find(tp->key_hashes, key_hash);
+    if (entry == NULL || entry->type != D_ENTRY) {
         printf("couldn't delete");
         return false;  // Not a Dentry
     }
 
-    int num_slabs = tp->d_entries[idx].num_slabs;
+    // Free the slot, other D-entries keep their slots so key_hashes stays valid
+    release_dentry_slot(tp, entry->slot);
 
     // Remove key_hash from the hash map
     hashmap_delete(tp->key_hashes, key_hash);  
 
-    // Delete dentry from dentries
-    for (int i = idx; i < tp->dentry_idx; i++) 
-        tp->d_entries[i] = tp->d_entries[i + 1]; 
-
-    // Clear the last entry (now a duplicate after shifting)
-    tp->d_entries[tp->dentry_idx - 1].key_hash = 0;  // Reset key_hash
-    tp->d_entries[tp->dentry_idx - 1].val = 0;       // Reset value
-    tp->d_entries[tp->dentry_idx - 1].klen = 0;      // Reset key length
-    tp->d_entries[tp->dentry_idx - 1].vlen = 0;      // Reset value length
-    tp->d_entries[tp->dentry_idx - 1].num_slabs = 0; // Reset slab count
-
-    //printf("\nDone deleting D-entry, d_entru\n");
-
-    // update indexes in key_hashes
-    update_key_hashes(tp);
-
-    tp->d_entry_slabs -= num_slabs; 
-    tp->dentry_idx--;
-
     return true;  // Deletion successful
 }
 
 // SHOULD BE DONE
 bool delete_ientry(TranslationPage *tp, uint64_t key_hash) {
-    if (hash_set_contains(tp->i_entries, key_hash)) {  // if key_hash in self.i_entries: (checks if key_hash is in Ientries)
-        hash_set_delete(tp->i_entries, key_hash);  // self.i_entries.remove(key_hash) (remove key_hash from i_entries)
+    HashMapEntry *entry = hashmap_find(tp->key_hashes, key_hash);
+    if (entry != NULL && entry->type == I_ENTRY) {  // if key_hash is an I-entry
         hashmap_delete(tp->key_hashes, key_hash);  // del self.key_hashes[key_hash] (delete key_hash from key_hashes)
         tp->i_entry_count--;  
         return true;  // Deletion successful
@@ -545,6 +893,170 @@ bool delete_ientry(TranslationPage *tp, uint64_t key_hash) {
     return false;  // Nothing to delete
 }
 
+// Moves the entry of key_hash from one page to another: a D-entry stays one if to has the
+// slabs and its threshold allows it, anything else arrives as an I-entry. The key was counted
+// when it was written, so to's insert counters don't change. False if to has no room or
+// already holds key_hash, from is left as it was then
+bool move_entry(TranslationPage *from, TranslationPage *to, uint64_t key_hash) {
+    HashMapEntry *entry = hashmap_find(from->key_hashes, key_hash);
+    if (entry == NULL || hashmap_find(to->key_hashes, key_hash) != NULL)
+        return false;
+
+    if (entry->type == D_ENTRY) {
+        DEntry *d = &from->d_entries[entry->slot];
+        bool d_entry = d->klen + d->vlen <= to->threshold
+                       && insert_dentry(to, key_hash, d->klen, d->vlen, dentry_key(from, d), d->val);
+        if (!d_entry && !insert_ientry(to, key_hash))
+            return false;
+        if (!d_entry)
+            to->evictions++;
+        release_dentry_slot(from, entry->slot);
+        hashmap_delete(from->key_hashes, key_hash);
+    } else {
+        if (!insert_ientry(to, key_hash))
+            return false;
+        delete_ientry(from, key_hash);
+    }
+    to->inserts--;
+    return true;
+}
+
+// Little endian fields of a flash image (plain copies on the little endian hosts we run on)
+static inline void put16(uint8_t *p, uint16_t v) { memcpy(p, &v, 2); }
+static inline void put32(uint8_t *p, uint32_t v) { memcpy(p, &v, 4); }
+static inline void put64(uint8_t *p, uint64_t v) { memcpy(p, &v, 8); }
+static inline uint16_t get16(const uint8_t *p) { uint16_t v; memcpy(&v, p, 2); return v; }
+static inline uint32_t get32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64_t get64(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+
+// Slabs the flash image of a D-entry takes: header, key and value, from a fresh slab
+static int flash_dentry_slabs(int slab_size, int key_len, int vlen) {
+    return (FLASH_DENTRY_HEADER + key_len + vlen + slab_size - 1) / slab_size;
+}
+
+// Slabs of a flash page after its header
+int flash_page_capacity(int page_size, int slab_size) {
+    return (page_size - FLASH_PAGE_HEADER) / slab_size;
+}
+
+// Slabs the flash image of tp takes, it fits if that is at most flash_page_capacity(). The
+// D-entry headers are why this can be more than the d_entry_slabs + i_entry_count tp counts
+int flash_page_slabs(TranslationPage *tp) {
+    int slabs = tp->i_entry_count;
+    for (int i = next_dentry(tp, 0); i != -1; i = next_dentry(tp, i + 1))
+        slabs += flash_dentry_slabs(tp->slab_size, tp->d_entries[i].key_len, tp->d_entries[i].vlen);
+    return slabs;
+}
+
+// Writes tp to out as the page_size bytes it would be programmed to flash as: the I-entry and
+// D-entry counts (FLASH_PAGE_HEADER), then slabs. Every I-entry is a slab holding its key
+// hash. Every D-entry starts on a fresh slab with a FLASH_DENTRY_HEADER, then its key and vlen
+// bytes of value. Rather than its 8 byte hash the header keeps i, where hash(key) + i * i is
+// the key hash (the retry it was placed by). Unused bytes are left erased (0xff). Returns
+// false if tp does not fit in the page
+bool encode_flash_page(TranslationPage *tp, key_hash_fn hash, void *out) {
+    uint8_t *page = (uint8_t*)out;
+    int slab = tp->slab_size;
+    if (slab < 8 || flash_page_slabs(tp) > flash_page_capacity(tp->page_size, slab))
+        return false;
+
+    put16(page, tp->i_entry_count);
+    put16(page + 2, tp->dentry_count);
+    uint8_t *p = page + FLASH_PAGE_HEADER;
+
+    // I-entries only live in key_hashes, most pages have none and skip the scan
+    HashMap *map = tp->key_hashes;
+    for (int i = 0, left = tp->i_entry_count; left > 0 && i < map->size; i++) {
+        if (map->table[i].type != I_ENTRY)
+            continue;
+        put64(p, map->table[i].key_hash);
+        memset(p + 8, 0xff, slab - 8);
+        p += slab;
+        left--;
+    }
+
+    for (int i = next_dentry(tp, 0); i != -1; i = next_dentry(tp, i + 1)) {
+        DEntry *entry = &tp->d_entries[i];
+        const char *key = dentry_key(tp, entry);
+        uint64_t delta = entry->key_hash - hash(key);
+        uint64_t retry = (uint64_t)sqrt((double)delta);
+        if (delta > 255 * 255 || retry * retry != delta || entry->key_len > 255 || entry->klen > 65535 || entry->vlen > 65535)
+            return false;
+
+        p[0] = (uint8_t)retry;
+        p[1] = (uint8_t)entry->key_len;
+        put16(p + 2, entry->klen);
+        put16(p + 4, entry->vlen);
+        put32(p + 6, entry->val);
+        uint8_t *data = p + FLASH_DENTRY_HEADER;
+        memcpy(data, key, entry->key_len);
+        memset(data + entry->key_len, 0, entry->vlen); // the value, KVSSD only keeps val
+        int bytes = flash_dentry_slabs(slab, entry->key_len, entry->vlen) * slab;
+        int used = FLASH_DENTRY_HEADER + entry->key_len + entry->vlen;
+        memset(p + used, 0xff, bytes - used);
+        p += bytes;
+    }
+
+    memset(p, 0xff, page + tp->page_size - p);
+    return true;
+}
+
+// Builds a translation page in mem, which must hold translation_page_bytes() bytes, from a
+// flash image encode_flash_page wrote with the same hash. Entries come back with their keys,
+// sizes and values, D-entries in the first slots. Counters start from zero, flash doesn't keep
+// them. Returns NULL if image is not a valid flash page
+TranslationPage* decode_flash_page(void *mem, const void *image, int page_size, int slab_size, int threshold, key_hash_fn hash) {
+    const uint8_t *page = (const uint8_t*)image;
+    TranslationPage *tp = init_translation_page(mem, page_size, slab_size, threshold);
+    int i_count = get16(page);
+    int d_count = get16(page + 2);
+    if (slab_size < 8 || i_count + d_count > tp->tt_slab)
+        return NULL;
+
+    const uint8_t *p = page + FLASH_PAGE_HEADER;
+    const uint8_t *end = p + (size_t)flash_page_capacity(page_size, slab_size) * slab_size;
+    if (i_count * slab_size > end - p)
+        return NULL;
+    for (int i = 0; i < i_count; i++) {
+        uint64_t key_hash = get64(p);
+        if (hashmap_find(tp->key_hashes, key_hash) != NULL)
+            return NULL;
+        hashmap_put(tp->key_hashes, key_hash, I_ENTRY, -1);
+        p += slab_size;
+    }
+    tp->i_entry_count = i_count;
+
+    char key[256];
+    for (int i = 0; i < d_count; i++) {
+        if (end - p < FLASH_DENTRY_HEADER)
+            return NULL;
+        int retry = p[0];
+        int key_len = p[1];
+        int klen = get16(p + 2);
+        int vlen = get16(p + 4);
+        int val = (int)get32(p + 6);
+        int bytes = flash_dentry_slabs(slab_size, key_len, vlen) * slab_size;
+        if (bytes > end - p)
+            return NULL;
+
+        memcpy(key, p + FLASH_DENTRY_HEADER, key_len);
+        key[key_len] = '\0';
+        uint64_t key_hash = hash(key) + (uint64_t)retry * retry;
+        int key_off = alloc_key(tp, key, key_len);
+        if (key_off == -1 || hashmap_find(tp->key_hashes, key_hash) != NULL)
+            return NULL;
+
+        int slabs = ceil((double)(klen + vlen) / slab_size);
+        tp->d_entries[i] = create_dentry(key_hash, key_off, key_len, val, klen, vlen, slabs);
+        tp->d_used[i / 64] |= 1ULL << (i % 64);
+        hashmap_put(tp->key_hashes, key_hash, D_ENTRY, i);
+        tp->dentry_count++;
+        tp->d_entry_slabs += slabs;
+        p += bytes;
+    }
+    return tp;
+}
+
 void generate_random_string_tp(char *str, int length) {
     const char charset[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
     for (int i = 0; i < length; i++) {
@@ -663,10 +1175,10 @@ int main() {
     insert(tp, key_hash4, 10, 90, "example_key4", 42); 
     insert(tp, key_hash4, 10, 2, "example_key5", 42);
 
-    printf("key_hash1 exist: %d\n",find_value_by_key_hash(tp, key_hash1, "example_key"));
+    printf("key_hash1 exist: %d\n",find_value_by_key_hash(tp, key_hash1));
     delete_dentry(tp, key_hash1);
-    printf("key_hash1 exist: %d\n",find_value_by_key_hash(tp, key_hash1, "example_key"));
-    printf("key_hash2 exist: %d\n",find_value_by_key_hash(tp, key_hash2, "example_key2"));
+    printf("key_hash1 exist: %d\n",find_value_by_key_hash(tp, key_hash1));
+    printf("key_hash2 exist: %d\n",find_value_by_key_hash(tp, key_hash2));
     print_dentries(tp);
     print_key_hashes(tp);
     
@@ -680,10 +1192,10 @@ int main() {
     insert(tp, key_hash4, 100, 90, "example_key4", 42); 
     insert(tp, key_hash4, 100, 2, "example_key5", 42);
     
-    printf("key_hash1 exist: %d\n",find_value_by_key_hash(tp, key_hash1, "example_key"));
+    printf("key_hash1 exist: %d\n",find_value_by_key_hash(tp, key_hash1));
     delete_ientry(tp, key_hash1);
-    printf("key_hash1 exist: %d\n",find_value_by_key_hash(tp, key_hash1, "example_key"));
-    printf("key_hash2 exist: %d\n",find_value_by_key_hash(tp, key_hash2, "example_key2"));
+    printf("key_hash1 exist: %d\n",find_value_by_key_hash(tp, key_hash1));
+    printf("key_hash2 exist: %d\n",find_value_by_key_hash(tp, key_hash2));
     print_ientries(tp);
     print_key_hashes(tp);
     
@@ -713,11 +1225,6 @@ int main() {
     print_tp_stats(tp);
 
     // Clean up resources before exiting (free memory, etc.)
-    free(tp->d_entries);
-    free(tp->i_entries->table);
-    free(tp->i_entries);
-    free(tp->key_hashes->table);
-    free(tp->key_hashes);
     free(tp);
 
     return 0; // Exit status
@@ -10,34 +10,46 @@
 #include <stdint.h>
 #include "math.h"
 
+// Open addressing tables are sized to a power of two so that the load factor
+// never goes above MAX_LOAD_NUM / MAX_LOAD_DEN for the requested number of entries
+#define MAX_LOAD_NUM 3
+#define MAX_LOAD_DEN 4
+
+// Control byte of a free key_hashes bucket. Taken ones hold a 7 bit fingerprint of their key_hash
+#define CTRL_EMPTY 0x80
+#define CTRL_TAIL 32 // control bytes repeated past the end of the table, so a group load never wraps
+
+// Type tag of a key_hashes entry, EMPTY_ENTRY marks a free bucket
+#define EMPTY_ENTRY 0
+#define D_ENTRY 1
+#define I_ENTRY 2
+
+// Flash page images, see encode_flash_page
+#define FLASH_PAGE_HEADER 4    // I-entry and D-entry counts before the first slab
+#define FLASH_DENTRY_HEADER 10 // retry delta, key_len, klen, vlen and val before a D-entry's key
+
 // Hashmap structures
 
 typedef struct {
     uint64_t key_hash;
-    int value; // -1 or index in d_entries array
-    bool is_occupied;
+    int slot;     // index in d_entries array for a D-entry, -1 for an I-entry
+    uint8_t type; // EMPTY_ENTRY, D_ENTRY or I_ENTRY
 } HashMapEntry;
 
 typedef struct {
     HashMapEntry *table;
-    int size;
+    uint8_t *ctrl; // control byte of every slot, then the first CTRL_TAIL of them again
+    int size;  // number of slots (power of two)
+    int mask;  // size - 1
+    int shift; // 64 - log2(size), used by hash_function_map
+    int count; // number of occupied slots
 } HashMap;
 
-// Hashset structures
-typedef struct {
-    uint64_t key_hash;
-    bool is_occupied;
-} HashSetEntry;
-
-typedef struct {
-    HashSetEntry *table;
-    int size;
-} HashSet;
-
 // Dentry structure
 typedef struct {
     uint64_t key_hash;
-    char *key; // Pointer for dynamic allocation
+    int key_off; // Offset of the NUL terminated key in the page's key arena
+    int key_len; // strlen of the key
     int val;
     int klen;
     int vlen;
@@ -46,15 +58,23 @@ typedef struct {
 
 
 typedef struct {
-    int threshold;
+    int threshold; // a KVSSD brings this up to date when it next writes the page
+    int page_size;
     int slab_size;
     int tt_slab;
 
+    // d_entries, d_used, key_hashes and keys all point into the page's own allocation
     DEntry *d_entries; //  [ {key_hash1, type1, klen1, vlen1, key1, va1} , {key_hash2, type2, klen2, vlen2, key2, va2} ...]
-    HashSet *i_entries;   // [key_hash1, key_hash2, key_hash3....]
-    HashMap *key_hashes;  // { (key_hash1 : index1) , (key_hash2 : index2)...}
+    uint64_t *d_used;     // bitmap of occupied d_entries slots, a D-entry keeps its slot until deleted
+    HashMap *key_hashes;  // { (key_hash1 : D, index1) , (key_hash2 : I)...} single index for both entry types
+    char *keys;           // Key arena for the D-entries, bump allocated and compacted when it runs out
 
-    int dentry_idx; // Index of D_entry in d_entries (i.e index to insert)
+    int keys_size; // Size of the key arena (page size plus one terminator per slab)
+    int keys_used; // Bump pointer into keys
+    int keys_live; // Bytes in keys still owned by a D-entry
+
+    int dentry_count; // Number of D-entries in d_entries
+    int evict_cursor; // Slot where insert_dentry_by_eviction resumes its search
 
     // Counters
     int d_entry_slabs;
@@ -71,34 +91,70 @@ typedef struct {
     int read_i_entry;
 } TranslationPage;
 
+// Hands out translation pages carved from large regions, one contiguous chunk per page
+typedef struct {
+    int page_size;
+    int slab_size;
+    size_t page_bytes;    // translation_page_bytes(page_size, slab_size)
+    int pages_per_region;
+    char *regions;        // most recent region, each region links to the previous one
+    int region_count;
+    char *next;           // next unused page in the current region
+    int left;             // unused pages left in the current region
+    void *free_list;      // released pages, linked through their first bytes
+    size_t pages_in_use;
+} PagePool;
+
+// Function a page's key hashes come from, before any retry offset is added
+typedef uint64_t (*key_hash_fn)(const char *key);
+
 // Function Prototypes
 void print_dentries(TranslationPage *tp);
 
 HashMap* create_hashmap(int size);
 
-int hash_function_map(uint64_t key_hash, int table_size);
+int hash_function_map(uint64_t key_hash, int shift);
+
+void hashmap_put(HashMap *map, uint64_t key_hash, uint8_t type, int slot);
 
-void hashmap_put(HashMap *map, uint64_t key_hash, int value);
+HashMapEntry* hashmap_find(HashMap *map, uint64_t key_hash);
 
 int hashmap_get(HashMap *map, uint64_t key_hash);
 
 void hashmap_delete(HashMap *map, uint64_t key_hash);
 
-HashSet* create_hash_set(int size);
+size_t translation_page_bytes(int page_size, int slab_size);
 
-int hash_function(uint64_t key_hash, int table_size);
+TranslationPage* init_translation_page(void *mem, int page_size, int slab_size, int threshold);
+TranslationPage* copy_translation_page(void *mem, TranslationPage *src);
+TranslationPage* rebase_translation_page(void *mem);
+void translation_page_image(TranslationPage *tp, void *out);
 
-void hash_set_put(HashSet *set, uint64_t key_hash);
+int flash_page_capacity(int page_size, int slab_size);
+int flash_page_slabs(TranslationPage *tp);
+bool encode_flash_page(TranslationPage *tp, key_hash_fn hash, void *out);
+TranslationPage* decode_flash_page(void *mem, const void *image, int page_size, int slab_size, int threshold, key_hash_fn hash);
 
-bool hash_set_contains(HashSet *set, uint64_t key_hash);
+TranslationPage* create_translation_page(int page_size, int slab_size, int threshold);
 
-void hash_set_delete(HashSet *set, uint64_t key_hash);
+void init_page_pool(PagePool *pool, int page_size, int slab_size, int pages_per_region);
 
-TranslationPage* create_translation_page(int page_size, int slab_size, int threshold);
+TranslationPage* page_pool_alloc(PagePool *pool, int threshold);
+TranslationPage* page_pool_copy(PagePool *pool, TranslationPage *src);
+
+void page_pool_free(PagePool *pool, TranslationPage *tp);
 
-DEntry create_dentry(uint64_t key_hash, const char *key, int val, int klen, int vlen, int num_slabs);
+void destroy_page_pool(PagePool *pool);
 
-void update_key_hashes(TranslationPage *tp);
+size_t tp_alloc_count(void);
+
+int alloc_key(TranslationPage *tp, const char *key, int key_len);
+
+const char* dentry_key(TranslationPage *tp, DEntry *entry);
+
+DEntry create_dentry(uint64_t key_hash, int key_off, int key_len, int val, int klen, int vlen, int num_slabs);
+
+int next_dentry(TranslationPage *tp, int slot);
 
 bool insert(TranslationPage *tp, uint64_t key_hash, int klen, int vlen, const char *key, int val);
 
@@ -108,10 +164,15 @@ bool insert_dentry_by_eviction(TranslationPage *tp, uint64_t key_hash, int klen,
 
 bool insert_ientry(TranslationPage *tp, uint64_t key_hash);
 
-bool find_value_by_key_hash(TranslationPage *tp, uint64_t key_hash, const char *key);
+uint8_t key_hash_type(TranslationPage *tp, uint64_t key_hash);
+uint8_t find_value_by_key_hash(TranslationPage *tp, uint64_t key_hash);
+void prefetch_page_index(TranslationPage *tp);
+void prefetch_key_hash(TranslationPage *tp, uint64_t key_hash);
 
 bool delete_dentry(TranslationPage *tp, uint64_t key_hash);
 
 bool delete_ientry(TranslationPage *tp, uint64_t key_hash);
 
+bool move_entry(TranslationPage *from, TranslationPage *to, uint64_t key_hash);
+
 #endif // TRANSLATIONPAGE_H